@@ -23,6 +23,15 @@ namespace RBX
 		private:
 			std::vector<ClassDescriptor*> derivedClasses;
 			ClassDescriptor* base;
+
+			// Pre-order position in the class hierarchy and the position of the last class derived from it.
+			// A class is derived from this one exactly when its id falls within [classId, lastDerivedId].
+			unsigned int classId;
+			unsigned int lastDerivedId;
+
+			// Signals declared by this class itself; their slots start after the base class's slots
+			std::vector<SignalDescriptor*> declaredSignals;
+			unsigned int signalSlotCount;
 		public:
 			static bool lockedDown;
 		  
@@ -36,11 +45,42 @@ namespace RBX
 			{
 				return base;
 			}
+			unsigned int getClassId() const
+			{
+				return classId;
+			}
+			// Number of signal slots used by this class and its bases
+			unsigned int getSignalSlotCount() const
+			{
+				return signalSlotCount;
+			}
+			void declareSignalSlot(SignalDescriptor* signal);
 			bool isBaseOf(const char*) const;
-			bool isBaseOf(const ClassDescriptor& base) const;
+			bool isBaseOf(const ClassDescriptor& derived) const
+			{
+				return derived.isA(*this);
+			}
 			bool isA(const char*) const;
-			bool isA(const ClassDescriptor&) const;
+			bool isA(const ClassDescriptor& other) const
+			{
+				return classId - other.classId <= other.lastDerivedId - other.classId;
+			}
 			std::vector<ClassDescriptor*>::const_iterator derivedClasses_begin() const;
+
+			// Bulk property access: reads or writes one property of count objects of this class
+			// (or a derived one) through a typed column, with no per-object virtual dispatch
+			template<typename PropType>
+			void getPropertyColumn(const TypedPropertyDescriptor<PropType>& desc, const DescribedBase* const* objects, size_t count, PropType* column) const
+			{
+				RBXASSERT(isA(desc.owner));
+				desc.getValues(objects, count, column);
+			}
+			template<typename PropType>
+			void setPropertyColumn(const TypedPropertyDescriptor<PropType>& desc, DescribedBase* const* objects, size_t count, const PropType* column) const
+			{
+				RBXASSERT(isA(desc.owner));
+				desc.setValues(objects, count, column);
+			}
 			std::vector<ClassDescriptor*>::const_iterator derivedClasses_end() const;
 			bool operator==(const ClassDescriptor& other) const;
 			bool operator!=(const ClassDescriptor& other) const;
@@ -48,6 +88,8 @@ namespace RBX
 			virtual ~ClassDescriptor();
 		public:
 			//ClassDescriptor& operator=(const ClassDescriptor&);
+		private:
+			static unsigned int number(ClassDescriptor& descriptor, unsigned int nextId);
 		  
 		public:
 			static ClassDescriptor& rootDescriptor() // TODO: check
@@ -115,6 +115,19 @@ namespace RBX
 				virtual bool isReadOnly() const = 0;
 				virtual PropType getValue(const DescribedBase*) const = 0;
 				virtual void setValue(DescribedBase*, const PropType&) const = 0;
+
+				// Column access: one virtual call for the whole array. Implementations override these
+				// with a direct loop; the defaults fall back to a virtual call per object.
+				virtual void getValues(const DescribedBase* const* objects, size_t count, PropType* values) const
+				{
+					for (size_t i = 0; i < count; ++i)
+						values[i] = getValue(objects[i]);
+				}
+				virtual void setValues(DescribedBase* const* objects, size_t count, const PropType* values) const
+				{
+					for (size_t i = 0; i < count; ++i)
+						setValue(objects[i], values[i]);
+				}
 			public:
 				//GetSet(const GetSet&);
 				GetSet()
@@ -146,6 +159,14 @@ namespace RBX
 			{
 				getset->setValue(object, value);
 			}
+			void getValues(const DescribedBase* const* objects, size_t count, PropType* values) const
+			{
+				getset->getValues(objects, count, values);
+			}
+			void setValues(DescribedBase* const* objects, size_t count, const PropType* values) const
+			{
+				getset->setValues(objects, count, values);
+			}
 			virtual bool equalValues(const DescribedBase*, const DescribedBase*) const;
 			virtual bool hasStringValue() const;
 			virtual std::string getStringValue(const DescribedBase*) const;
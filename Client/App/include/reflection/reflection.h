@@ -1,4 +1,5 @@
 #pragma once
+#include <boost/type_traits/remove_const.hpp>
 #include "reflection/object.h"
 
 class ArchiveBinder;
@@ -49,6 +50,44 @@ namespace RBX
 				return foo;
 			}
 		};
+
+		// Overload resolution only picks the first describedTag when Class itself derives from Described<Class, ...>.
+		// Classes that merely inherit a description (interfaces, undescribed subclasses) get the second.
+		template<typename Class, const char** ClassName, typename DerivedClass>
+		char (&describedTag(const Described<Class, ClassName, DerivedClass>*))[2];
+		template<typename Class>
+		char (&describedTag(const void*))[1];
+
+		template<typename Class>
+		struct IsDescribed
+		{
+			enum { value = sizeof(describedTag<Class>((const Class*)0)) == 2 };
+		};
+
+		// Downcast of a DescribedBase-derived object. Described classes are checked against the
+		// ClassDescriptor id ranges; anything else falls back to dynamic_cast.
+		template<typename To, bool isDescribed = IsDescribed<typename boost::remove_const<To>::type>::value>
+		struct DescribedCast
+		{
+			template<typename From>
+			static To* cast(From* object)
+			{
+				return dynamic_cast<To*>(object);
+			}
+		};
+
+		template<typename To>
+		struct DescribedCast<To, true>
+		{
+			template<typename From>
+			static To* cast(From* object)
+			{
+				if (object && object->getDescriptor().isA(boost::remove_const<To>::type::classDescriptor()))
+					return static_cast<To*>(object);
+				else
+					return NULL;
+			}
+		};
 	}
 
 	template<typename Class, typename DerivedClass, const char** ClassName>
@@ -137,6 +176,16 @@ namespace RBX
 						o->raisePropertyChanged(desc);
 					}
 				}
+				virtual void getValues(const DescribedBase* const* objects, size_t count, PropType* values) const
+				{
+					for (size_t i = 0; i < count; ++i)
+						values[i] = ((const Class*)objects[i])->*member;
+				}
+				virtual void setValues(DescribedBase* const* objects, size_t count, const PropType* values) const
+				{
+					for (size_t i = 0; i < count; ++i)
+						BoundPropGetSet::setValue(objects[i], values[i]);
+				}
 			};
 
 		public:
@@ -185,6 +234,15 @@ namespace RBX
 				{
 					throw std::runtime_error("can't set value");
 				}
+				virtual void getValues(const DescribedBase* const* objects, size_t count, ReturnType* values) const
+				{
+					for (size_t i = 0; i < count; ++i)
+						values[i] = (((Class*)objects[i])->*get)();
+				}
+				virtual void setValues(DescribedBase* const* objects, size_t count, const ReturnType* values) const
+				{
+					throw std::runtime_error("can't set value");
+				}
 				//GetImpl& operator=(const GetImpl&);
 			};
 
@@ -216,6 +274,15 @@ namespace RBX
 					Class* o = (Class*)object;
 					(o->*set)(value);
 				}
+				virtual void getValues(const DescribedBase* const* objects, size_t count, ReturnType* values) const
+				{
+					throw std::runtime_error("can't get value");
+				}
+				virtual void setValues(DescribedBase* const* objects, size_t count, const ReturnType* values) const
+				{
+					for (size_t i = 0; i < count; ++i)
+						(((Class*)objects[i])->*set)(values[i]);
+				}
 				//SetImpl& operator=(const SetImpl&);
 			};
 
@@ -250,6 +317,16 @@ namespace RBX
 					Class* o = (Class*)object;
 					(o->*set)(value);
 				}
+				virtual void getValues(const DescribedBase* const* objects, size_t count, ReturnType* values) const
+				{
+					for (size_t i = 0; i < count; ++i)
+						values[i] = (((Class*)objects[i])->*get)();
+				}
+				virtual void setValues(DescribedBase* const* objects, size_t count, const ReturnType* values) const
+				{
+					for (size_t i = 0; i < count; ++i)
+						(((Class*)objects[i])->*set)(values[i]);
+				}
 				//GetSetImpl& operator=(const GetSetImpl&);
 			};
 
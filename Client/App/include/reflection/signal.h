@@ -4,7 +4,7 @@
 #include <boost/noncopyable.hpp>
 #include <boost/signals.hpp>
 #include <boost/any.hpp>
-#include <map>
+#include <stdexcept>
 #include <vector>
 #include "reflection/function.h"
 #include "util/Utilities.h"
@@ -13,12 +13,88 @@ namespace RBX
 {
 	namespace Reflection
 	{
+		// Arguments of a signal being fired, passed to generic slots without copying or boxing them.
+		// Only pointers to the caller's arguments are kept, so a pack must not outlive the fire.
+		class SignalArguments : public boost::noncopyable
+		{
+		public:
+			// Roblox signals have at most two arguments
+			enum { MaxArgs = 2 };
+
+		private:
+			typedef boost::any (*BoxFunction)(const void*);
+
+			size_t count;
+			const void* values[MaxArgs];
+			const Type* types[MaxArgs];
+			BoxFunction boxers[MaxArgs];
+
+			template<typename T>
+			static boost::any box(const void* value)
+			{
+				return boost::any(*static_cast<const T*>(value));
+			}
+
+		public:
+			SignalArguments()
+				: count(0)
+			{
+			}
+
+			template<typename T>
+			void push(const T& value)
+			{
+				RBXASSERT(count < MaxArgs);
+				values[count] = &value;
+				types[count] = &Type::singleton<T>();
+				boxers[count] = &box<T>;
+				++count;
+			}
+
+			size_t size() const
+			{
+				return count;
+			}
+			const Type& type(size_t i) const
+			{
+				RBXASSERT(i < count);
+				return *types[i];
+			}
+			// T is the argument type without reference or top-level const
+			template<typename T>
+			const T& get(size_t i) const
+			{
+				RBXASSERT(i < count);
+				RBXASSERT(types[i] == &Type::singleton<T>());
+				return *static_cast<const T*>(values[i]);
+			}
+
+			// Copies the arguments into the boxed form used by GenericSlotWrapper::execute(const std::vector<boost::any>&)
+			void toAny(std::vector<boost::any>& result) const
+			{
+				result.resize(count);
+				for (size_t i = 0; i < count; ++i)
+					result[i] = boxers[i](values[i]);
+			}
+		};
+
 		class GenericSlotWrapper
 		{
 		public:
 			virtual ~GenericSlotWrapper();
 		public:
-			virtual void execute(const std::vector<boost::any>&) = 0;
+			// A wrapper overrides one of these. Generic slots are called with SignalArguments;
+			// the default boxes them for wrappers that only implement the vector form.
+			virtual void execute(const std::vector<boost::any>&)
+			{
+				throw std::runtime_error("GenericSlotWrapper implements neither form of execute");
+			}
+			virtual void execute(const SignalArguments& arguments)
+			{
+				std::vector<boost::any> args;
+				arguments.toAny(args);
+				execute(args);
+			}
 		public:
 			//GenericSlotWrapper(const GenericSlotWrapper&);
 			GenericSlotWrapper();
@@ -58,17 +134,22 @@ namespace RBX
 			friend class SignalDescriptor;
 
 		private:
-			boost::scoped_ptr<std::map<const SignalDescriptor*, boost::shared_ptr<SignalInstance>>> signals;
+			// indexed by SignalDescriptor slot, allocated when the first signal instance is created
+			boost::scoped_ptr<std::vector<boost::shared_ptr<SignalInstance>>> signals;
 		  
 		public:
 			virtual ~SignalSource();
 		public:
 			void disconnect_all_slots();
+			// heap bytes of the signal table and the signal instances created so far
+			size_t getSignalBytes() const;
 		};
 
 		class Signal;
 		class SignalDescriptor : public MemberDescriptor
 		{
+			friend class ClassDescriptor;
+
 		public:
 			typedef Signal Describing;
 
@@ -76,6 +157,10 @@ namespace RBX
 			void (*signalCreatedHook)(SignalSource*);
 		protected:
 			SignatureDescriptor signature;
+		private:
+			// Dense per-class index into SignalSource::signals. A class's slots follow those of its base,
+			// so the slots of every signal a source can raise are distinct. Assigned by ClassDescriptor.
+			unsigned int slot;
 		  
 		public:
 			//SignalDescriptor(const SignalDescriptor&);
@@ -187,7 +272,11 @@ namespace RBX
 				//GenericSlotAdapter(const GenericSlotAdapter&);
 				GenericSlotAdapter(GenericSlotWrapper*);
 			public:
-				void operator()();
+				void operator()()
+				{
+					SignalArguments args;
+					wrapper->execute(args);
+				}
 			public:
 				~GenericSlotAdapter();
 			public:
@@ -234,8 +323,8 @@ namespace RBX
 			public:
 				void operator()(typename FunctionTraits<CallbackSignature>::Arg1Type arg1)
 				{
-					std::vector<boost::any> args(1);
-					args[0] = boost::any(arg1);
+					SignalArguments args;
+					args.push(arg1);
 
 					wrapper->execute(args);
 				}
@@ -283,7 +372,14 @@ namespace RBX
 				//GenericSlotAdapter(const GenericSlotAdapter&);
 				GenericSlotAdapter(GenericSlotWrapper*);
 			public:
-				void operator()(typename FunctionTraits<CallbackSignature>::Arg1Type arg1, typename FunctionTraits<CallbackSignature>::Arg2Type arg2);
+				void operator()(typename FunctionTraits<CallbackSignature>::Arg1Type arg1, typename FunctionTraits<CallbackSignature>::Arg2Type arg2)
+				{
+					SignalArguments args;
+					args.push(arg1);
+					args.push(arg2);
+
+					wrapper->execute(args);
+				}
 			public:
 				~GenericSlotAdapter();
 			public:
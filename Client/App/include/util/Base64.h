@@ -0,0 +1,39 @@
+#pragma once
+#include <ostream>
+#include <string>
+
+namespace RBX
+{
+	class MD5Hasher;
+
+	// Block based base64 for embedded content. Unlike base64.hpp, which moves one byte at a time
+	// through stream iterators, this decodes whole groups of four characters with a lookup table
+	// and hands the output over in blocks.
+	class Base64Decoder
+	{
+	private:
+		std::string& out;
+		MD5Hasher* hasher;
+		unsigned int bits;
+		int count;
+		bool padded;
+		bool failed;
+		char block[3 * 1024];
+		size_t blockSize;
+
+	public:
+		// Appends to out. If hasher is given it sees every decoded byte
+		Base64Decoder(std::string& out, MD5Hasher* hasher = NULL);
+
+		// Text can arrive in pieces of any size. Whitespace is skipped
+		void decode(const char* text, size_t size);
+		// False if the text held something other than base64 or stopped partway through a group
+		bool finish();
+
+	private:
+		void flush();
+	};
+
+	// Same output as base64<char>::put: a newline after every 72 characters
+	void base64Encode(const char* data, size_t size, std::ostream& out);
+}
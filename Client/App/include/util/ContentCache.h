@@ -0,0 +1,121 @@
+#pragma once
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <hash_map>
+#include <list>
+#include <string>
+#include <vector>
+
+namespace RBX
+{
+	// Downloaded content, by ContentId string, in two tiers.
+	// The memory tier is an LRU bounded by the bytes it holds. The optional disk tier stores each
+	// piece of content once, in a file named after the MD5 of its data, and keeps an index file
+	// mapping ids to hashes so it survives restarts. Content evicted from memory is reloaded from
+	// disk on the next lookup, and dropped from the disk tier if it no longer matches its hash.
+	// The disk tier is an LRU of files bounded by their bytes; the index is appended to as entries
+	// change and rewritten, oldest first, once most of its lines are stale.
+	class ContentCache : public boost::noncopyable
+	{
+	public:
+		struct Entry
+		{
+			boost::shared_ptr<const std::string> data;
+			boost::shared_ptr<const std::string> filename; // the disk tier file, if any
+
+			Entry()
+			{
+			}
+		};
+
+		struct Statistics
+		{
+			unsigned int hits;		// found in memory
+			unsigned int diskHits;	// found on disk and brought back into memory
+			unsigned int misses;
+			unsigned int evictions;
+			unsigned int diskEvictions; // files removed to stay under the disk limit
+			size_t bytes;			// held by the memory tier
+			size_t diskBytes;		// held by the disk tier
+			size_t entries;
+
+			Statistics()
+				: hits(0),
+				  diskHits(0),
+				  misses(0),
+				  evictions(0),
+				  diskEvictions(0),
+				  bytes(0),
+				  diskBytes(0),
+				  entries(0)
+			{
+			}
+		};
+
+	private:
+		struct Node
+		{
+			std::string id;
+			Entry entry;
+			size_t bytes;
+		};
+
+		typedef std::list<Node> Lru; // most recently used first
+		typedef stdext::hash_map<std::string, Lru::iterator> MemoryIndex;
+		typedef stdext::hash_map<std::string, std::string> DiskIndex; // id -> MD5 of the data
+
+		struct DiskFile
+		{
+			std::string hash;
+			size_t bytes;
+			std::vector<std::string> ids; // every id whose content this is
+		};
+
+		typedef std::list<DiskFile> DiskLru; // most recently used first
+		typedef stdext::hash_map<std::string, DiskLru::iterator> DiskFiles; // by hash
+
+		mutable boost::mutex mutex;
+		Lru lru;
+		MemoryIndex memoryIndex;
+		size_t maxBytes;
+		std::string diskFolder;
+		DiskIndex diskIndex;
+		DiskLru diskLru;
+		DiskFiles diskFiles;
+		size_t maxDiskBytes;
+		size_t indexLines; // in the index file, stale ones included
+		Statistics statistics;
+
+	public:
+		ContentCache(size_t maxBytes, size_t maxDiskBytes);
+
+		void setMaxBytes(size_t value);
+		void setMaxDiskBytes(size_t value);
+		// Enables the disk tier and loads its index. An empty folder disables it
+		void setDiskFolder(const std::string& folder);
+
+		bool find(const std::string& id, Entry& entry);
+		bool contains(const std::string& id) const;
+		// Adds to memory, and to disk when the disk tier is enabled
+		void insert(const std::string& id, const boost::shared_ptr<const std::string>& data);
+
+		void clearMemory();
+		void clearDisk();
+
+		Statistics getStatistics() const;
+
+	private:
+		void insertMemory(const std::string& id, const Entry& entry);
+		void evict();
+		std::string diskPath(const std::string& hash) const;
+		void addDiskEntry(const std::string& id, const std::string& hash, size_t bytes);
+		void touchDisk(const std::string& hash);
+		void dropDiskId(const std::string& id);
+		void removeDiskFile(DiskFiles::iterator file);
+		void evictDisk();
+		void appendIndex(const std::string& id, const std::string& hash);
+		void compactIndex();
+		void writeIndex();
+	};
+}
@@ -1,9 +1,13 @@
 #pragma once
 #include "util/Name.h"
 #include "util/boost.hpp"
+#include "util/ContentCache.h"
 #include <string>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <list>
+#include <map>
+#include <vector>
 
 namespace RBX
 {
@@ -83,9 +87,52 @@ namespace RBX
 		static ContentId fromMD5Hash(const std::string&);
 	};
 
+	// Result of a background content fetch, shared by everyone who asked for the same ContentId
+	// while it was in flight
+	class ContentFuture : private boost::noncopyable
+	{
+		friend class ContentProvider;
+
+	private:
+		mutable boost::mutex sync;
+		boost::condition readyCondition;
+		bool ready;
+		boost::shared_ptr<const std::string> data;
+		std::string error;
+
+	public:
+		ContentFuture()
+			: ready(false)
+		{
+		}
+
+	public:
+		bool isReady() const;
+		// Blocks until the fetch is done. NULL if it failed
+		boost::shared_ptr<const std::string> wait();
+		// Only meaningful once ready
+		boost::shared_ptr<const std::string> getData() const;
+		std::string getError() const;
+
+	private:
+		void complete(const boost::shared_ptr<const std::string>& data, const std::string& error);
+	};
+
 	class Instance;
 	class ContentProvider : private boost::noncopyable
 	{
+	public:
+		// Queued fetches are started in this order; a class only waits for the ones before it
+		enum RequestPriority
+		{
+			ScriptPriority,
+			DefaultPriority,
+			MeshPriority,
+			TexturePriority,
+			SoundPriority,
+			PriorityCount
+		};
+
 	private:
 		enum HttpRequestType
 		{
@@ -94,45 +141,28 @@ namespace RBX
 			SyncHttpRequest
 		};
 
-		struct CachedContent
-		{
-		public:
-			boost::shared_ptr<const std::string> data;
-			boost::shared_ptr<const std::string> filename;
-		  
-		public:
-			//CachedContent(const CachedContent&);
-			CachedContent();
-			~CachedContent();
-		public:
-			//CachedContent& operator=(const CachedContent&);
-		};
+		typedef ContentCache::Entry CachedContent;
 
-		struct FailedUrl
-		{
-		public:
-			std::string url;
-			boost::posix_time::ptime expiration;
-		  
-		public:
-			//FailedUrl(const FailedUrl&);
-			FailedUrl(const char*);
-		public:
-			bool expired() const;
-		public:
-			~FailedUrl();
-		public:
-			//FailedUrl& operator=(const FailedUrl&);
+		struct PendingRequest
+		{
+			ContentId id;
+			std::string host; // empty for content that isn't fetched over http
+			RequestPriority priority;
+			boost::shared_ptr<ContentFuture> future;
 		};
 
 	private:
 		boost::mutex requestSync;
-		std::list<ContentId> requestQueue;
-		std::list<FailedUrl> failedUrls;
-		boost::mutex contentCacheMutex;
-		std::map<ContentId, CachedContent> contentCache;
+		std::list<PendingRequest> requestQueues[PriorityCount];
+		// queued or being fetched, by ContentId. Later requests for the same id share the future
+		std::map<std::string, boost::shared_ptr<ContentFuture>> inFlight;
+		std::map<std::string, int> activeHostRequests;
+		int maxRequestsPerHost;
+		// urls that failed to load recently, by url, with when they may be tried again
+		stdext::hash_map<std::string, boost::posix_time::ptime> failedUrls;
+		ContentCache contentCache;
 		std::string assetFolderPath;
-		boost::scoped_ptr<worker_thread> requestProcessor;
+		std::vector<boost::shared_ptr<worker_thread>> requestProcessors;
 	  
 	public:
 		//ContentProvider(const ContentProvider&);
@@ -143,13 +173,29 @@ namespace RBX
 	public:
 		ContentId registerContent(std::istream& content, const Name& mimeType);
 		ContentId registerContent(const char*, const Name&);
+		// Content already in memory, with the MD5 of its data. The cache takes the buffer as it is
+		ContentId registerContent(const boost::shared_ptr<const std::string>& data, const std::string& hash, const Name& mimeType);
 		void clearFileCache();
 		bool isUrlBad(const char*);
 		void load(ContentId, std::vector<boost::shared_ptr<Instance>>&);
 		void clearContentCache();
 		bool isRequestQueueEmpty();
 		bool hasContent(ContentId);
+		// Bytes of content kept in memory. The least recently used content goes first
+		void setContentCacheLimit(size_t bytes);
+		// Keeps downloaded content in the folder as well, so it survives eviction and restarts
+		void setContentCacheFolder(const char* folder);
+		// Bytes of files kept in that folder, likewise least recently used first
+		void setContentCacheDiskLimit(size_t bytes);
+		ContentCache::Statistics getContentCacheStatistics() const;
 		boost::shared_ptr<const std::string> requestContentString(ContentId);
+		// Starts fetching the content in the background unless it is cached or already on its way
+		boost::shared_ptr<ContentFuture> fetchContent(ContentId id);
+		boost::shared_ptr<ContentFuture> fetchContent(ContentId id, RequestPriority priority);
+		void setFetchWorkerCount(int count);
+		int getFetchWorkerCount() const;
+		// Fetches running against one host at a time. Content from files is not limited
+		void setMaxRequestsPerHost(int count);
 		bool requestContentFile(ContentId, std::string&);
 		boost::shared_ptr<const std::string> getContentString(ContentId);
 		std::auto_ptr<std::istream> getContent(ContentId);
@@ -159,8 +205,12 @@ namespace RBX
 		std::string assetFolder() const;
 		ContentId readContent(const char*, std::istream&, unsigned);
 	private:
-		RBX::ContentProvider::CachedContent* loadContent(ContentId, HttpRequestType);
+		// Loads the content into contentCache. False if it could not be found
+		bool loadContent(ContentId, HttpRequestType);
+		void markUrlBad(const std::string& url);
 		worker_thread::work_result processRequests();
+		bool takeNextRequest(PendingRequest& request);
+		void wakeRequestProcessors();
 		std::string findFile(ContentId);
 		std::string findAsset(ContentId);
 		std::string findHashFile(ContentId);
@@ -172,6 +222,8 @@ namespace RBX
 		static ContentProvider& singleton();
 		static bool isUrl(const std::string&);
 		static bool isHttpUrl(const std::string&);
+		static RequestPriority priorityOf(const ContentId& id);
+		static std::string hostOf(const std::string& url);
 	};
 
 	class MD5Hasher
@@ -189,6 +241,9 @@ namespace RBX
 		MD5Hasher()
 		{
 		}
+		virtual ~MD5Hasher()
+		{
+		}
 	public:
 		//MD5Hasher& operator=(const MD5Hasher&);
 
@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <vector>
 
 namespace RBX
@@ -9,11 +10,19 @@ namespace RBX
 	struct RaiseRange
 	{
 	public:
-		size_t index;
+		size_t index;	// the next listener to call
 		size_t upper;
 		RaiseRange* previous;
 	public:
-		void removeIndex(unsigned int);
+		// keeps an in-progress raise on the right listener when one it has already called
+		// (including the current one) or has yet to call is removed
+		void removeIndex(unsigned int removed)
+		{
+			if (removed < upper)
+				--upper;
+			if (removed < index)
+				--index;
+		}
 	};
 
 	template<typename Class, typename Event>
@@ -31,30 +40,73 @@ namespace RBX
 		Listener();
 	};
 
+	// Most objects never get a listener for most of their events (an Instance is six Notifiers), so
+	// the listener list is only allocated while it is non-empty. Empty notifiers cost one pointer.
 	template<typename Class, typename Event>
 	class __declspec(novtable) Notifier
 	{
 	private:
-		std::vector<Listener<Class, Event>*> listeners;
+		typedef std::vector<Listener<Class, Event>*> Listeners;
+
+		mutable Listeners* listeners;
 		mutable RaiseRange* raiseRange;
 
 	protected:
 		//Notifier(const Notifier&);
 		Notifier()
-			: listeners(),
+			: listeners(NULL),
 			  raiseRange(NULL)
 		{
 		}
+		~Notifier()
+		{
+			delete listeners;
+		}
 		Notifier& operator=(const Notifier&);
 
 	public:
-		void addListener(Listener<Class, Event>*) const;
-		void removeListener(Listener<Class, Event>*) const;
+		void addListener(Listener<Class, Event>* listener) const
+		{
+			if (!listeners)
+				listeners = new Listeners();
+
+			listeners->push_back(listener);
+			onAddListener(listener);
+		}
+		void removeListener(Listener<Class, Event>* listener) const
+		{
+			if (!listeners)
+				return;
+
+			typename Listeners::iterator iter = std::find(listeners->begin(), listeners->end(), listener);
+			if (iter == listeners->end())
+				return;
+
+			unsigned int removed = (unsigned int)(iter - listeners->begin());
+			listeners->erase(iter);
+
+			for (RaiseRange* range = raiseRange; range; range = range->previous)
+				range->removeIndex(removed);
+
+			if (listeners->empty())
+			{
+				delete listeners;
+				listeners = NULL;
+			}
+
+			onRemoveListener(listener);
+		}
+
+		// heap bytes held for listeners
+		size_t getListenerBytes() const
+		{
+			return listeners ? sizeof(Listeners) + listeners->capacity() * sizeof(Listener<Class, Event>*) : 0;
+		}
 
 	protected:
 		bool hasListeners() const
 		{
-			return !listeners.empty();
+			return listeners != NULL;
 		}
 		// TODO: does not match
 		void raise(Event event, Listener<Class, Event>* listener) const
@@ -63,13 +115,17 @@ namespace RBX
 		}
 		void raise(Event event) const
 		{
-			RaiseRange range = {0, listeners.size(), raiseRange};
+			if (!listeners)
+				return;
+
+			RaiseRange range = {0, listeners->size(), raiseRange};
 
 			raiseRange = &range;
 
-			for(; range.index < range.upper; range.index++)
+			// a listener may remove the last listener, which frees the list (and sets upper to 0)
+			while (range.index < range.upper)
 			{
-				raise(event, listeners[range.index]);
+				raise(event, (*listeners)[range.index++]);
 			}
 
 			raiseRange = range.previous;
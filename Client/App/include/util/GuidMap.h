@@ -0,0 +1,180 @@
+#pragma once
+#include "util/Guid.h"
+#include "util/Debug.h"
+#include <vector>
+#include <algorithm>
+
+namespace RBX
+{
+	// Flat open-addressed table keyed by Guid::Data.
+	// Scopes are interned Names, so a key is identified by its scope pointer and 24-bit index alone.
+	// Uses linear probing with backward-shift deletion, so there are no tombstones to clean up.
+	template<typename T>
+	class GuidMap
+	{
+	private:
+		struct Slot
+		{
+			Guid::Data key; // key.scope == NULL marks an empty slot
+			T value;
+		};
+
+	private:
+		std::vector<Slot> slots;
+		size_t count;
+
+	public:
+		GuidMap()
+			: count(0)
+		{
+		}
+
+		size_t size() const
+		{
+			return count;
+		}
+
+		bool empty() const
+		{
+			return count == 0;
+		}
+
+		void clear()
+		{
+			std::vector<Slot>().swap(slots);
+			count = 0;
+		}
+
+		// Grows the table up-front so that n items can be inserted without rehashing
+		void reserve(size_t n)
+		{
+			size_t capacity = 16;
+			while (!fits(n, capacity))
+				capacity <<= 1;
+
+			if (capacity > slots.size())
+				rehash(capacity);
+		}
+
+		T* find(const Guid::Data& key)
+		{
+			if (count == 0)
+				return NULL;
+
+			size_t i = locate(key);
+			return slots[i].key.scope ? &slots[i].value : NULL;
+		}
+
+		const T* find(const Guid::Data& key) const
+		{
+			return const_cast<GuidMap*>(this)->find(key);
+		}
+
+		T& operator[](const Guid::Data& key)
+		{
+			RBXASSERT(key.scope != NULL);
+
+			if (!fits(count + 1, slots.size()))
+				rehash(slots.empty() ? 16 : slots.size() * 2);
+
+			size_t i = locate(key);
+			if (!slots[i].key.scope)
+			{
+				slots[i].key = key;
+				++count;
+			}
+			return slots[i].value;
+		}
+
+		bool erase(const Guid::Data& key)
+		{
+			if (count == 0)
+				return false;
+
+			size_t i = locate(key);
+			if (!slots[i].key.scope)
+				return false;
+
+			size_t mask = slots.size() - 1;
+			size_t j = i;
+			while (true)
+			{
+				j = (j + 1) & mask;
+				if (!slots[j].key.scope)
+					break;
+
+				// Leave items whose home slot lies cyclically within (i, j]
+				size_t home = hash(slots[j].key) & mask;
+				if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+					continue;
+
+				slots[i].key = slots[j].key;
+				std::swap(slots[i].value, slots[j].value);
+				i = j;
+			}
+
+			slots[i].key.scope = NULL;
+			slots[i].value = T();
+			--count;
+			return true;
+		}
+
+		template<class Func>
+		void for_each(Func func) const
+		{
+			for (size_t i = 0; i < slots.size(); ++i)
+			{
+				if (slots[i].key.scope)
+					func(slots[i].key, slots[i].value);
+			}
+		}
+
+	private:
+		static bool fits(size_t n, size_t capacity)
+		{
+			// keep the load factor at or below 0.75
+			return n * 4 <= capacity * 3;
+		}
+
+		static size_t hash(const Guid::Data& key)
+		{
+			size_t h = reinterpret_cast<size_t>(key.scope) >> 3;
+			h ^= static_cast<size_t>(key.index) * 0x9e3779b1u;
+			return h ^ (h >> 15);
+		}
+
+		// Returns the slot holding key, or the empty slot where it would be inserted
+		size_t locate(const Guid::Data& key) const
+		{
+			size_t mask = slots.size() - 1;
+			size_t i = hash(key) & mask;
+			while (slots[i].key.scope)
+			{
+				if (slots[i].key.scope == key.scope && slots[i].key.index == key.index)
+					break;
+				i = (i + 1) & mask;
+			}
+			return i;
+		}
+
+		void rehash(size_t capacity)
+		{
+			RBXASSERT((capacity & (capacity - 1)) == 0);
+
+			std::vector<Slot> old(capacity);
+			for (size_t i = 0; i < capacity; ++i)
+				old[i].key.scope = NULL;
+			old.swap(slots);
+
+			for (size_t i = 0; i < old.size(); ++i)
+			{
+				if (old[i].key.scope)
+				{
+					size_t j = locate(old[i].key);
+					slots[j].key = old[i].key;
+					std::swap(slots[j].value, old[i].value);
+				}
+			}
+		}
+	};
+}
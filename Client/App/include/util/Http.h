@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <iosfwd>
 
 namespace RBX
 {
@@ -16,6 +17,9 @@ namespace RBX
 	public:
 		void post(std::istream&, bool, std::string&);
 		void get(std::string&);
+		// Write the response body to the stream as it downloads instead of collecting it first
+		void post(std::istream& input, bool compress, std::ostream& response);
+		void get(std::ostream& response);
 	public:
 		~Http();
 
@@ -1,8 +1,14 @@
 #pragma once
 #include "util/Debug.h"
+#include <boost/scoped_ptr.hpp>
 #include <string>
 #include <fstream>
 
+namespace boost
+{
+	class thread;
+}
+
 namespace RBX
 {
 	class Log;
@@ -28,19 +34,47 @@ namespace RBX
 			Error
 		};
 
+	private:
+		struct Entry;
+
 	public:
 		Severity worstSeverity;
 		const std::string logFile;
 	private:
 		std::ofstream stream;
+
+		// Entries are pushed by any thread without locking and written out in batches by the
+		// writer thread. The queue is a list in reverse order that the writer takes in one swap
+		Entry* volatile queueHead;
+		volatile long queuedEntries;
+		volatile long droppedEntries;
+		volatile bool stopRequest;
+		void* wakeEvent;
+		boost::scoped_ptr<boost::thread> writer;
+
+		// entry times are ticks since the log opened, added to the wall clock time it opened at
+		unsigned __int64 startTime;
+		unsigned long startTicks;
 	public:
 		static Severity aggregateWorstSeverity;
 	private:
 		static ILogProvider* provider;
+		static const long maxQueuedEntries = 4096;
+		static const unsigned long flushIntervalMs = 1000;
 
 	public:
+		// Queues the entry and returns. When the queue is full the entry is dropped and counted
 		void writeEntry(Severity, const char*);
+		// Writes directly; only while the writer thread isn't running
 		void timeStamp(bool);
+		long getDroppedEntries() const
+		{
+			return droppedEntries;
+		}
+	private:
+		void writerProc();
+		// false when the queue was empty; sets wroteError if any of the entries was an Error
+		bool writeQueued(bool& wroteError);
 	public:
 		//Log(const Log&);
 		Log(const char*, const char*);
@@ -0,0 +1,90 @@
+#pragma once
+#include <map>
+#include <set>
+#include <string>
+#include "util/Name.h"
+
+namespace RBX
+{
+	// Heap bytes owned by a tree of objects, broken down by Instance class and by subsystem.
+	// Filled in by Instance::reportMemory. Blocks shared between several owners (interned names,
+	// for instance) are counted once, against the first owner that reports them.
+	class MemoryReport
+	{
+	public:
+		struct Usage
+		{
+			size_t count;
+			size_t bytes;
+
+			Usage()
+				: count(0),
+				  bytes(0)
+			{
+			}
+		};
+
+		typedef std::map<std::string, Usage> UsageMap;
+
+		// subsystems
+		static const char* const Instances;
+		static const char* const Names;
+		static const char* const Children;
+		static const char* const Listeners;
+		static const char* const Signals;
+		static const char* const Primitives;
+		static const char* const Geometries;
+		static const char* const Bodies;
+		static const char* const SimBodies;
+		static const char* const Surfaces;
+		static const char* const SpatialNodes;
+
+	private:
+		UsageMap classes;
+		UsageMap subsystems;
+		std::set<const void*> sharedBlocks;
+		size_t totalBytes;
+
+	public:
+		MemoryReport();
+
+		// One object of the class. Its own block is booked under Instances
+		void addObject(const Name& className, size_t bytes);
+		void add(const char* subsystem, const Name& className, size_t bytes);
+		void addShared(const void* block, const char* subsystem, const Name& className, size_t bytes);
+
+		const UsageMap& getClasses() const
+		{
+			return classes;
+		}
+		const UsageMap& getSubsystems() const
+		{
+			return subsystems;
+		}
+		size_t getTotalBytes() const
+		{
+			return totalBytes;
+		}
+	};
+
+	// Allocation of long lived engine objects (everything made through Creatable).
+	// In compaction mode objects are carved out of pools with one free list per object size, which
+	// drops the per-block heap overhead and keeps instances of a class next to each other. Switching
+	// the mode is safe at any time: blocks are always returned to wherever they came from.
+	class Memory
+	{
+	public:
+		static void setCompaction(bool value);
+		static bool getCompaction();
+
+		static void* allocateObject(size_t size);
+		static void freeObject(void* ptr, size_t size);
+
+		// Usable size of a heap block returned by allocateObject or by operator new
+		static size_t blockSize(const void* ptr);
+
+		// Bytes the object pools have taken from the heap, and how many of them are handed out
+		static size_t getPoolReservedBytes();
+		static size_t getPoolUsedBytes();
+	};
+}
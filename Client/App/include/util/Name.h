@@ -9,10 +9,11 @@ namespace RBX
 	class Name : boost::noncopyable
 	{
 	private:
-		typedef std::map<std::string, Name*> NamMap;
+		struct Table;
 
 	private:
 		int dictionaryIndex;
+		size_t hash;
 	public:
 		const std::string name;
 
@@ -46,9 +47,10 @@ namespace RBX
 		}
 
 	private:
-		Name(const char* sName, int dictionaryIndex)
+		Name(const char* sName, int dictionaryIndex, size_t hash)
 			: name(sName),
-			  dictionaryIndex(dictionaryIndex)
+			  dictionaryIndex(dictionaryIndex),
+			  hash(hash)
 		{}
 	public:
 		~Name() {}
@@ -56,7 +58,9 @@ namespace RBX
 	private:
 		static boost::mutex& mutex();
 		static std::map<int, Name*>& dictionary();
-		static NamMap& namMap();
+		static Table* volatile table;
+		static const Name* find(const char* sName, size_t length, size_t hash);
+		static void insert(Name* name);
 
 	public:
 		static const Name& getNullName();
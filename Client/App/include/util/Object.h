@@ -2,6 +2,7 @@
 #include <boost/shared_ptr.hpp>
 #include <map>
 #include "util/Name.h"
+#include "util/Memory.h"
 
 namespace RBX
 {
@@ -68,11 +69,12 @@ namespace RBX
 	private:
 		static void* operator new(size_t size)
 		{
-			return malloc(size);
+			return Memory::allocateObject(size);
 		}
-		static void operator delete(void* ptr)
+		// the size of the most derived class, so pooled blocks go back to the right pool
+		static void operator delete(void* ptr, size_t size)
 		{
-			free(ptr);
+			Memory::freeObject(ptr, size);
 		}
 	};
 
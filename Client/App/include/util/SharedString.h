@@ -0,0 +1,56 @@
+#pragma once
+#include <string>
+
+namespace RBX
+{
+	// Immutable reference counted string, one pointer per holder.
+	// Strings are interned: everything built from equal text shares it, so 100,000 parts named
+	// "Part" hold a single copy between them.
+	class SharedString
+	{
+	private:
+		struct Rep
+		{
+			volatile long refs;
+			const std::string value;
+
+			Rep(const std::string& value)
+				: refs(1),
+				  value(value)
+			{
+			}
+		};
+
+		Rep* rep; // NULL for the empty string
+
+	public:
+		SharedString()
+			: rep(NULL)
+		{
+		}
+		SharedString(const std::string& value);
+		SharedString(const char* value);
+		SharedString(const SharedString& other);
+		~SharedString();
+
+		SharedString& operator=(const SharedString& other);
+
+		const std::string& str() const
+		{
+			return rep ? rep->value : empty();
+		}
+
+		// The heap block shared by every holder of this text, and the bytes behind it
+		const void* getBlock() const
+		{
+			return rep;
+		}
+		size_t getHeapBytes() const;
+
+	private:
+		static const std::string& empty();
+		static Rep* make(const std::string& value);
+		static void addRef(Rep* rep);
+		static void release(Rep* rep);
+	};
+}
@@ -0,0 +1,202 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include "util/Debug.h"
+#include <windows.h>
+
+namespace RBX
+{
+	// Vector with cheap immutable snapshots, used in place of CopyOnWrite<std::vector<T>> where
+	// readers iterate while the owner keeps writing.
+	//
+	// A snapshot shares the owner's storage and remembers its length. The storage records the longest
+	// length ever handed out ("sealed"); everything past it belongs to the owner alone, so appends and
+	// erases behind the sealed mark happen in place even while snapshots are alive. Only a write in
+	// front of the mark, or growth beyond capacity, moves the owner onto fresh storage - once, after
+	// which the old snapshots keep the old storage and the owner continues in place.
+	//
+	// read() is const and may be called from several threads at once; the sealed mark is only ever
+	// raised, with interlocked operations, and the owner reads it the same way. The owner's writes
+	// still need the usual exclusion against readers, as the storage itself is swapped by them.
+	template<typename T>
+	class SnapshotVector : public boost::noncopyable
+	{
+	private:
+		struct Buffer
+		{
+			std::vector<T> items;
+			volatile long sealed;
+
+			Buffer()
+				: sealed(0)
+			{
+			}
+		};
+
+	public:
+		class Snapshot
+		{
+			friend class SnapshotVector;
+
+		private:
+			boost::shared_ptr<const Buffer> buffer;
+			size_t count;
+
+			Snapshot(const boost::shared_ptr<const Buffer>& buffer, size_t count)
+				: buffer(buffer),
+				  count(count)
+			{
+			}
+
+		public:
+			// plain pointers, so an empty snapshot without storage still has a valid (empty) range
+			typedef const T* const_iterator;
+
+			Snapshot()
+				: count(0)
+			{
+			}
+
+			size_t size() const
+			{
+				return count;
+			}
+			bool empty() const
+			{
+				return count == 0;
+			}
+			const T& operator[](size_t i) const
+			{
+				RBXASSERT(i < count);
+				return buffer->items[i];
+			}
+			const_iterator begin() const
+			{
+				return count ? &buffer->items[0] : NULL;
+			}
+			const_iterator end() const
+			{
+				return begin() + count;
+			}
+		};
+
+	private:
+		boost::shared_ptr<Buffer> buffer;
+		unsigned int removals;
+
+	public:
+		SnapshotVector()
+			: removals(0)
+		{
+		}
+
+		// Counts erase/clear calls, so that caches built over the items can tell whether any
+		// item moved since they were built (appends never move existing items)
+		unsigned int removalCount() const
+		{
+			return removals;
+		}
+
+		size_t size() const
+		{
+			return buffer ? buffer->items.size() : 0;
+		}
+		bool empty() const
+		{
+			return size() == 0;
+		}
+		size_t capacity() const
+		{
+			return buffer ? buffer->items.capacity() : 0;
+		}
+		const T& operator[](size_t i) const
+		{
+			return buffer->items[i];
+		}
+		const T& back() const
+		{
+			return buffer->items.back();
+		}
+
+		// Snapshots are O(1) and stay valid and unchanged whatever the owner does afterwards
+		Snapshot read() const
+		{
+			if (!buffer)
+				return Snapshot();
+
+			size_t count = buffer->items.size();
+
+			long sealed = buffer->sealed;
+			while (sealed < (long)count)
+			{
+				long seen = InterlockedCompareExchange(&buffer->sealed, (long)count, sealed);
+				if (seen == sealed)
+					break;
+				sealed = seen;
+			}
+
+			return Snapshot(buffer, count);
+		}
+
+		void reserve(size_t capacity)
+		{
+			if (capacity > size())
+				own(size(), capacity);
+		}
+
+		void push_back(const T& item)
+		{
+			own(size(), size() + 1);
+			buffer->items.push_back(item);
+		}
+
+		void erase(size_t index)
+		{
+			RBXASSERT(index < size());
+			own(index, size());
+			buffer->items.erase(buffer->items.begin() + index);
+			++removals;
+		}
+
+		void clear()
+		{
+			buffer.reset();
+			++removals;
+		}
+
+	private:
+		// Makes the slots from firstWrite onwards writable and room for capacity items, without
+		// disturbing any outstanding snapshot
+		void own(size_t firstWrite, size_t capacity)
+		{
+			if (!buffer)
+			{
+				buffer.reset(new Buffer());
+			}
+			else if (buffer.unique())
+			{
+				// no snapshots alive
+				InterlockedExchange(&buffer->sealed, 0);
+			}
+
+			std::vector<T>& items = buffer->items;
+			bool overwritesSnapshot = firstWrite < (size_t)InterlockedCompareExchange(&buffer->sealed, 0, 0);
+			bool reallocates = capacity > items.capacity();
+			size_t newCapacity = reallocates ? std::max(capacity, items.capacity() * 2) : items.capacity();
+
+			if (reallocates && !overwritesSnapshot && buffer.unique())
+			{
+				items.reserve(newCapacity);
+			}
+			else if (reallocates || overwritesSnapshot)
+			{
+				boost::shared_ptr<Buffer> fresh(new Buffer());
+				fresh->items.reserve(newCapacity);
+				fresh->items.assign(items.begin(), items.end());
+				buffer = fresh;
+			}
+		}
+	};
+}
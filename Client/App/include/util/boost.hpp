@@ -3,6 +3,8 @@
 #include <boost/noncopyable.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/condition.hpp>
+#include <boost/function.hpp>
+#include <string>
 
 namespace RBX
 {
@@ -23,12 +25,14 @@ namespace RBX
 		public:
 			boost::mutex sync;
 			boost::condition wakeCondition;
+			bool wakeRequest;
 			bool endRequest;
 		  
 		public:
 			//data(const data&);
 			data()
-				: endRequest(false)
+				: wakeRequest(false),
+				  endRequest(false)
 			{
 			}
 			~data()
@@ -58,4 +62,44 @@ namespace RBX
 	private:
 		static void threadProc(boost::shared_ptr<data>, const boost::function0<enum work_result>&);
 	};
+
+	// Fixed set of background threads that share the iterations of a parallel_for.
+	// The calling thread works on the loop as well. Do not call parallel_for from inside a loop body.
+	class thread_pool : public boost::noncopyable
+	{
+	private:
+		boost::mutex runSync;
+		boost::mutex sync;
+		boost::condition wakeCondition;
+		boost::condition doneCondition;
+		const boost::function1<void, size_t>* job;
+		size_t jobCount;
+		size_t nextIndex;
+		size_t pending;
+		std::string error;
+		bool endRequest;
+		boost::thread_group threads;
+		int threadCount;
+
+	public:
+		thread_pool(int threadCount, const char* name);
+		~thread_pool();
+
+	public:
+		int size() const
+		{
+			return threadCount + 1;
+		}
+
+		// Calls func(i) for every i in [0, count) and returns once all calls have finished
+		void parallel_for(size_t count, const boost::function1<void, size_t>& func);
+
+	private:
+		void work();
+		void threadProc();
+
+	public:
+		// Shared pool with one thread per additional processor
+		static thread_pool& singleton();
+	};
 }
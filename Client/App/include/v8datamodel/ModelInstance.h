@@ -5,6 +5,7 @@
 #include "util/ICameraSubject.h"
 #include "util/ISelectable3d.h"
 #include "util/Extents.h"
+#include <map>
 
 namespace RBX
 {
@@ -18,10 +19,29 @@ namespace RBX
 						  public virtual ICameraSubject,
 						  public virtual ISelectable3d
 	{
+	private:
+		// The primitives under one direct child, expressed in this model's frame
+		struct ChildExtents
+		{
+			Extents extents;
+			bool dirty;
+
+			ChildExtents()
+				: dirty(true)
+			{
+			}
+		};
+
 	private:
 		mutable G3D::CoordinateFrame modelInPrimary;
 		mutable PartInstance* primaryPart;
+		mutable bool noPrimaryPartCandidate; // set when the last search found nothing, until a descendent is added
 		boost::shared_ptr<PartInstance> candidatePrimaryPart;
+		// Moving a part only dirties the slot of the child it sits under, at each level up to the
+		// root, so the next query refits one child per level instead of walking the whole subtree
+		mutable std::map<const Instance*, ChildExtents> childExtents;
+		mutable G3D::CoordinateFrame childExtentsFrame; // the location childExtents are expressed in
+		ComputeProp<Extents, ModelInstance> PrimitiveExtents; // union of childExtents; negative infinite without primitives
 		ComputeProp<float, ModelInstance> FlagHeight;
 		ComputeProp<Extents, ModelInstance> LocalGridExtents;
 		ComputeProp<Extents, ModelInstance> WorldGridExtents;
@@ -34,7 +54,9 @@ namespace RBX
 		float computeFlagHeight() const;
 		Extents computeLocalGridExtents() const;
 		Extents computeWorldGridExtents() const;
+		Extents computePrimitiveExtents() const;
 		void dirtyAll() const;
+		void dirtyChildExtents(const Instance* descendent) const;
 		virtual bool shouldRender3dAdorn() const;
 		virtual void render3dAdorn(Adorn* adorn);
 		virtual void render3dSelect(Adorn* adorn, SelectState selectState);
@@ -42,7 +64,9 @@ namespace RBX
 		virtual void onDescendentAdded(Instance* instance);
 		virtual void onDescendentRemoving(const boost::shared_ptr<Instance>& instance);
 		virtual bool askSetParent(const Instance* instance) const;
+		virtual void onChildExtentsChanged(const PVInstance* child) const;
 	private:
+		static Extents computeChildExtents(const Instance* child, const G3D::CoordinateFrame& location);
 		virtual void onLastChildRemoved()
 		{
 		}
@@ -81,6 +81,9 @@ namespace RBX
 		virtual void onChildControllerChanged();
 		virtual void onParentControllerChanged();
 		virtual void onExtentsChanged() const;
+		// Called on the parent when a child's extents changed. Containers that cache per-child
+		// extents refresh just that child's entry
+		virtual void onChildExtentsChanged(const PVInstance* child) const;
 	public:
 		void moveToPoint(G3D::Vector3 point);
 		// TODO: does not match
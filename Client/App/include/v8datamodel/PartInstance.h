@@ -97,6 +97,7 @@ namespace RBX
 		{
 			return primitive.get();
 		}
+		virtual void reportMemory(MemoryReport& report) const;
 		void setPartTypeUi(Part::PartType);
 		void setPartSizeUi(const G3D::Vector3&);
 		void setPartSizeUnjoined(const G3D::Vector3&);
@@ -80,6 +80,10 @@ namespace RBX
 		virtual bool askSetParent(const Instance*) const;
 		virtual bool askAddChild(const Instance*) const;
 		virtual void readProperty(const XmlElement*, IReferenceBinder&);
+		virtual bool canStageProperties() const
+		{
+			return false;
+		}
 		virtual const G3D::CoordinateFrame getLocation() const;
 		virtual bool drawSelected() const;
 		virtual void onLocalClicked();
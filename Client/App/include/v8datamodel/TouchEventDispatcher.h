@@ -0,0 +1,81 @@
+#pragma once
+#include <boost/noncopyable.hpp>
+#include <map>
+#include <vector>
+
+namespace RBX
+{
+	class World;
+	class Primitive;
+
+	// Delivers the Touched events World collected during the last UI step.
+	// Call dispatch() once after World::step. Each (part, other) pair is delivered at most once per
+	// UI step, ordered by the parts' Guids, and every part is resolved before any event fires so
+	// scripts that delete parts from a Touched handler can't pull them out from under the rest of
+	// the batch.
+	class TouchEventDispatcher : public boost::noncopyable
+	{
+	public:
+		struct Metrics
+		{
+			int reported;		// pairs World reported, including duplicates
+			int duplicates;		// pairs dropped because they were already reported this step
+			int rateLimited;	// pairs dropped by the per-part rate limit
+			int delivered;		// Touched events fired
+
+			Metrics()
+				: reported(0),
+				  duplicates(0),
+				  rateLimited(0),
+				  delivered(0)
+			{
+			}
+		};
+
+	private:
+		struct TouchPair
+		{
+			Primitive* touch;
+			Primitive* other;
+
+			bool operator<(const TouchPair& other) const;
+			bool operator==(const TouchPair& other) const;
+		};
+
+		struct RateWindow
+		{
+			double start;
+			int count;
+		};
+
+		std::vector<TouchPair> pairs;
+		std::map<const Primitive*, RateWindow> rateWindows;
+		int maxTouchesPerSecond;
+		Metrics lastStep;
+		Metrics total;
+
+	public:
+		TouchEventDispatcher();
+
+		// Limits how many Touched events a single part raises per second. 0 disables the limit
+		void setMaxTouchesPerSecond(int value);
+		int getMaxTouchesPerSecond() const
+		{
+			return maxTouchesPerSecond;
+		}
+
+		void dispatch(const World& world);
+
+		const Metrics& getLastStepMetrics() const
+		{
+			return lastStep;
+		}
+		const Metrics& getTotalMetrics() const
+		{
+			return total;
+		}
+
+	private:
+		bool withinRateLimit(const Primitive* touch, double now);
+	};
+}
@@ -9,6 +9,7 @@
 #include "v8kernel/KernelIndex.h"
 #include "v8kernel/Cofm.h"
 #include "util/math.h"
+#include "util/Memory.h"
 
 namespace RBX {
 	//class SimBody;
@@ -51,6 +52,8 @@ namespace RBX {
 			int& getKernelIndex() {return kernelIndex;}
 			Body();
 			~Body();
+			// this body, its cofm and sim body
+			void reportMemory(MemoryReport& report, const Name& owner) const;
 			void step(float, bool);
 			bool cofmIsClean();
 			void makeCofmDirty();
@@ -13,12 +13,17 @@
 #include "util/Association.h"
 #include "util/Utilities.h"
 #include "util/Guid.h"
+#include "util/SnapshotVector.h"
+#include "util/SharedString.h"
+#include "util/Memory.h"
 
 namespace RBX
 {
 	class Instance;
 	class ServiceProvider;
 	class RaiseDescendentAdded2;
+	class XmlInstanceReader;
+	class XmlParallelReader;
 
 	// EVENTS
 	// TODO: are these meant to be here?
@@ -147,12 +152,21 @@ namespace RBX
 					 public boost::noncopyable
 	{
 		friend class RaiseDescendentAdded2;
+		friend class XmlInstanceReader;
+		friend class XmlParallelReader;
+
+	public:
+		typedef SnapshotVector<boost::shared_ptr<Instance>> Children;
+
+	private:
+		struct NameIndex;
 
 	private:
 		Association<Instance> assoc;
 		Instance* parent;
-		CopyOnWrite<std::vector<boost::shared_ptr<Instance>>> children;
-		std::string name;
+		Children children;
+		mutable std::auto_ptr<NameIndex> nameIndex; // built on demand once there are enough children
+		SharedString name;
 		bool archivable;
 		Guid guid;
 
@@ -207,7 +221,7 @@ namespace RBX
 		void promoteChildren();
 		const std::string& getName() const
 		{
-			return name;
+			return name.str();
 		}
 		virtual void setName(const std::string& value);
 		bool isAncestorOf(const Instance* descendent) const;
@@ -218,23 +232,22 @@ namespace RBX
 		int findChildIndex(const Instance*) const;
 		const Instance* getChild(size_t i) const
 		{
-			return (*children)[i].get();
+			return children[i].get();
 		}
 		Instance* getChild(size_t i)
 		{
-			return (*children)[i].get();
+			return children[i].get();
 		}
 		Instance* findFirstChildByName(const std::string&) const;
 		Instance* findFirstChildByNameRecursive(const std::string&) const;
 		boost::shared_ptr<Instance> findFirstChildByName2(std::string, bool);
-		const CopyOnWrite<std::vector<boost::shared_ptr<Instance>>>& getChildren() const
+		const Children& getChildren() const
 		{
 			return children;
 		}
-		boost::shared_ptr<const std::vector<boost::shared_ptr<Instance>>> getChildren2()
-		{
-			return children.read();
-		}
+		boost::shared_ptr<const std::vector<boost::shared_ptr<Instance>>> getChildren2();
+		// Parents each instance to this one in order, reserving room for all of them up front
+		void addChildren(const std::vector<boost::shared_ptr<Instance>>& instances);
 		bool canAddChild(const boost::shared_ptr<Instance>& instance) const;
 		bool canAddChild(const Instance*) const;
 		bool canSetParent(const Instance*) const;
@@ -261,6 +274,11 @@ namespace RBX
 		void writeProperties(XmlElement*) const;
 	protected:
 		virtual void readProperty(const XmlElement* propertyElement, IReferenceBinder& binder);
+		// false when readProperty intercepts ordinary properties, so values may not be decoded off-thread
+		virtual bool canStageProperties() const
+		{
+			return true;
+		}
 	public:
 		virtual void onServiceProvider(const ServiceProvider*, const ServiceProvider*);
 		void readProperties(const XmlElement* container, IReferenceBinder& binder);
@@ -272,6 +290,11 @@ namespace RBX
 		void readChildren(const XmlElement* element, IReferenceBinder& binder);
 		void readChild(const XmlElement* childElement, IReferenceBinder& binder);
 		void raisePropertyChanged(const Reflection::PropertyDescriptor& descriptor);
+		// Adds the heap bytes this instance owns, not counting its children. Classes that own
+		// more than the base (parts, for instance) extend it
+		virtual void reportMemory(MemoryReport& report) const;
+		// The whole subtree, archivable or not
+		static void reportTreeMemory(const Instance* root, MemoryReport& report);
 	protected:
 		void raiseChanged(const Reflection::PropertyDescriptor&);
 		virtual void onChildChanged(Instance* instance, const PropertyChanged& event);
@@ -281,13 +304,10 @@ namespace RBX
 		template<typename Function>
 		void for_eachChild(Function func) const
 		{
-			if (&(*children))
+			Children::Snapshot c = children.read();
+			for (Children::Snapshot::const_iterator iter = c.begin(); iter != c.end(); iter++)
 			{
-				boost::shared_ptr<const std::vector<boost::shared_ptr<Instance>>> c = children.read();
-				for (std::vector<boost::shared_ptr<Instance>>::const_iterator iter = c->begin(); iter != c->end(); iter++)
-				{
-					func((*iter).get());
-				}
+				func((*iter).get());
 			}
 		}
 
@@ -302,6 +322,7 @@ namespace RBX
 	  
 	private:
 		static void predelete(Instance* instance);
+		const NameIndex* getNameIndex() const;
 	public:
 		static XmlElement* toNewXmlRoot(Instance*);
 		static boost::shared_ptr<Instance> fromXmlRoot(XmlElement*);
@@ -312,16 +333,21 @@ namespace RBX
 		static void signalDescendentRemoving(const boost::shared_ptr<Instance>&, Instance*, Instance*);
 	public:
 		// NOTE: This is entirely inlined. See assertions in later client builds.
+		// Described classes are tested with ClassDescriptor ids instead of RTTI.
 		template<typename To>
 		static To* fastDynamicCast(Instance* instance)
 		{
-			return dynamic_cast<To*>(instance);
+			To* result = Reflection::DescribedCast<To>::cast(instance);
+			RBXASSERT(result == dynamic_cast<To*>(instance));
+			return result;
 		}
 
 		template<typename To>
 		static To* fastDynamicCast(const Instance* instance)
 		{
-			return dynamic_cast<To*>(instance);
+			To* result = Reflection::DescribedCast<To>::cast(instance);
+			RBXASSERT(result == dynamic_cast<To*>(instance));
+			return result;
 		}
 
 		// TODO: remove the __forceinline
@@ -9,6 +9,7 @@
 #include "v8world/SurfaceData.h"
 #include "v8world/RigidJoint.h"
 #include "util/Guid.h"
+#include "util/Memory.h"
 #include "util/Vector3int32.h"
 #include "util/Extents.h"
 #include "util/SurfaceType.h"
@@ -233,6 +234,8 @@ namespace RBX
 			return surfaceType[id];
 		}
 		void setSurfaceData(NormalId id, const SurfaceData& newSurfaceData);
+		// heap bytes of the primitive and everything it owns, booked against the owner's class
+		void reportMemory(MemoryReport& report, const Name& owner) const;
 		const SurfaceData& getSurfaceData(NormalId id) const
 		{
 			// TODO: get this fully matching
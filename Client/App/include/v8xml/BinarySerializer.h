@@ -0,0 +1,78 @@
+#pragma once
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace RBX
+{
+	class Instance;
+
+	// Columnar binary place/model format.
+	//
+	// Layout (little endian):
+	//   header     magic, version, instance count, class count
+	//   strings    shared string table (u32 length + bytes) referenced by index
+	//   instances  (class index, parent index) per instance in document order, -1 = top level
+	//   classes    per class: name string, property count, then one typed column per property
+	//              holding a value for every instance of that class in document order
+	//
+	// Every column has a fixed element size so a loader can walk a mapped file without copying it.
+	class BinarySerializer
+	{
+	public:
+		enum ColumnType
+		{
+			COLUMN_STRING = 0,
+			COLUMN_BOOL = 1,
+			COLUMN_INT = 2,
+			COLUMN_FLOAT = 3,
+			COLUMN_VECTOR3 = 4,
+			COLUMN_COLOR3 = 5,
+			COLUMN_CFRAME = 6,
+			COLUMN_ENUM = 7,
+			COLUMN_REF = 8
+		};
+
+		static const char MAGIC[8];
+		static const unsigned int VERSION;
+
+	public:
+		static bool isBinary(const char* data, size_t size);
+		static bool isBinary(std::istream& stream);
+
+		static void save(std::ostream& stream, const std::vector<boost::shared_ptr<Instance>>& instances);
+
+		// Creates the instances in data. Top-level instances are created by and parented to root
+		// (when root is non-NULL) and appended to result.
+		static void load(const char* data, size_t size, Instance* root, std::vector<boost::shared_ptr<Instance>>& result);
+		static void loadFile(const std::string& fileName, Instance* root, std::vector<boost::shared_ptr<Instance>>& result);
+
+		static void convertXmlToBinary(std::istream& xml, std::ostream& binary);
+		static void convertBinaryToXml(const char* data, size_t size, std::ostream& xml);
+	};
+
+	// Read-only memory mapping of an entire file
+	class MappedFile : public boost::noncopyable
+	{
+	private:
+		void* file;
+		void* mapping;
+		const char* view;
+		size_t size;
+
+	public:
+		MappedFile(const std::string& fileName);
+		~MappedFile();
+
+		const char* data() const
+		{
+			return view;
+		}
+		size_t length() const
+		{
+			return size;
+		}
+	};
+}
@@ -5,6 +5,7 @@
 namespace RBX
 {
 	class DataModel;
+	class Instance;
 
 	// NOTE: may not be intended for this file
 	class IReferenceBinder
@@ -45,6 +46,133 @@ namespace RBX
 	};
 }
 
+namespace RBX
+{
+	// Creates instances while the document is still being parsed, so that only one property
+	// element at a time is materialized. An Item is parented after its subtree has been read,
+	// in the same order as Instance::readChild.
+	// Ref property elements are kept alive because binders may defer their resolution; the reader
+	// must outlive the binder's resolveRefs call.
+	class XmlInstanceReader : public XmlContentHandler, private boost::noncopyable
+	{
+	private:
+		struct Frame
+		{
+			enum Type
+			{
+				IGNORED = 0,
+				ITEM = 1,
+				PROPERTIES = 2,
+				PROPERTY = 3
+			};
+
+			Type type;
+			boost::shared_ptr<Instance> instance;
+			XmlElement* element;
+
+			Frame(Type type, const boost::shared_ptr<Instance>& instance, XmlElement* element)
+				: type(type),
+				  instance(instance),
+				  element(element)
+			{
+			}
+		};
+
+	private:
+		Instance* root;
+		IReferenceBinder& binder;
+		std::vector<Frame> frames;
+		std::vector<XmlElement*> retained;
+		std::vector<boost::shared_ptr<Instance>> instances;
+
+	public:
+		XmlInstanceReader(Instance* root, IReferenceBinder& binder);
+		~XmlInstanceReader();
+
+		virtual void startElement(XmlElement* element);
+		virtual void endElement();
+
+		// Top-level instances in document order
+		const std::vector<boost::shared_ptr<Instance>>& getInstances() const
+		{
+			return instances;
+		}
+
+	private:
+		void startItem(XmlElement* element);
+		void endItem(const boost::shared_ptr<Instance>& instance);
+	};
+}
+
+namespace RBX
+{
+	// Reads a parsed document in three passes. Instances are created on the calling thread,
+	// then simple property values (bool, int, float, Vector3, Color3, CFrame) are decoded into
+	// staging buffers on thread_pool, then values are applied and instances parented on the
+	// calling thread in document order. Binder calls happen in the same order as Instance::read,
+	// so the result is identical to the single-threaded path.
+	class XmlParallelReader : private boost::noncopyable
+	{
+	private:
+		enum StagedType
+		{
+			STAGED_NONE = 0,
+			STAGED_BOOL = 1,
+			STAGED_INT = 2,
+			STAGED_FLOAT = 3,
+			STAGED_VECTOR3 = 4,
+			STAGED_COLOR3 = 5,
+			STAGED_CFRAME = 6
+		};
+
+		struct StagedProperty
+		{
+			const XmlElement* element;
+			const Reflection::PropertyDescriptor* desc;
+			StagedType type;
+			union
+			{
+				bool boolValue;
+				int intValue;
+				float floatValues[12];
+			};
+		};
+
+		struct Item
+		{
+			const XmlElement* element;
+			boost::shared_ptr<Instance> instance;
+			std::vector<StagedProperty> properties;
+			std::vector<size_t> children;
+		};
+
+	private:
+		Instance* root;
+		IReferenceBinder& binder;
+		std::vector<Item> items;
+		std::vector<size_t> topLevel;
+		std::vector<boost::shared_ptr<Instance>> instances;
+
+	public:
+		XmlParallelReader(Instance* root, IReferenceBinder& binder);
+
+		// Reads the Item children of container, like Instance::readChildren
+		void read(const XmlElement* container);
+
+		const std::vector<boost::shared_ptr<Instance>>& getInstances() const
+		{
+			return instances;
+		}
+
+	private:
+		void create(const XmlElement* container, Instance* parent, std::vector<size_t>& created);
+		void decodeRange(size_t batch);
+		void apply(size_t index);
+
+		static bool decode(StagedProperty& property, const Reflection::ClassDescriptor& classDescriptor);
+	};
+}
+
 class ArchiveBinder : public RBX::MergeBinder
 {
 private:
@@ -75,6 +203,8 @@ public:
   
 public:
 	void loadInstances(XmlElement*, std::vector<boost::shared_ptr<RBX::Instance>>&);
+	void loadInstances(std::istream&, std::vector<boost::shared_ptr<RBX::Instance>>&);
+	void loadInstancesParallel(const XmlElement*, std::vector<boost::shared_ptr<RBX::Instance>>&);
 	void load(std::istream&, RBX::DataModel*);
 	void loadXML(std::istream&, RBX::DataModel*);
 	void merge(const XmlElement*, RBX::DataModel*);
@@ -1,17 +1,26 @@
 #pragma once
 #include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
 #include <iostream>
 #include <memory>
-#include <stack>
 #include <vector>
 #include <set>
 #include "v8xml/XmlElement.h"
 
+// Receives a parse one element at a time instead of as a finished tree.
+// startElement passes ownership of an element that has its attributes and value but no children yet.
+class XmlContentHandler
+{
+public:
+	virtual ~XmlContentHandler() {}
+	virtual void startElement(XmlElement* element) = 0;
+	virtual void endElement() = 0;
+};
+
 class XmlParser : public boost::noncopyable
 {
 protected:
 	std::streambuf* buffer;
-	std::stack<XmlElement*> elements;
   
 public:
 	//XmlParser(const XmlParser&);
@@ -39,16 +48,19 @@ public:
 
 public:
 	virtual std::auto_ptr<XmlElement> parse();
+	void parse(XmlContentHandler& handler);
 
 private:
 	void skipWhitespace();
 	std::string readTag();
 	std::string readFirstTag();
 	std::string readText(bool);
+	boost::shared_ptr<const std::string> readBinary(std::string& hash);
 	std::string removeTag(const std::string&, int&);
 	std::string findNextToken(const std::string&, int&);
 	std::string findText(const std::string&);
 	XmlElement* parseAttributes(const std::string&);
+	void readValue(XmlElement*);
 
 public:
 	~TextXmlParser();
@@ -13,13 +13,20 @@ namespace RBX
 			  SignalContainer(&base),
 			  FunctionContainer(&base),
 			  derivedClasses(),
-			  base(&base)
+			  base(&base),
+			  classId(0),
+			  lastDerivedId(0),
+			  declaredSignals(),
+			  signalSlotCount(0)
 		{
 			RBXASSERT(!lockedDown);
 
 			{
 				boost::recursive_mutex::scoped_lock lock(sync_0());
 				base.derivedClasses.push_back(this);
+
+				// Descriptors are all created during startup, so renumbering the whole tree each time is cheap
+				number(rootDescriptor(), 0);
 			}
 		}
 
@@ -29,8 +36,40 @@ namespace RBX
 			  SignalContainer(NULL),
 			  FunctionContainer(NULL),
 			  derivedClasses(),
-			  base(NULL)
+			  base(NULL),
+			  classId(0),
+			  lastDerivedId(0),
+			  declaredSignals(),
+			  signalSlotCount(0)
+		{
+		}
+
+		void ClassDescriptor::declareSignalSlot(SignalDescriptor* signal)
+		{
+			RBXASSERT(!lockedDown);
+
+			boost::recursive_mutex::scoped_lock lock(sync_0());
+			declaredSignals.push_back(signal);
+
+			// a base class may declare signals after its derived classes did, so shift everything
+			number(rootDescriptor(), 0);
+		}
+
+		unsigned int ClassDescriptor::number(ClassDescriptor& descriptor, unsigned int nextId)
 		{
+			descriptor.classId = nextId++;
+
+			unsigned int firstSlot = descriptor.base ? descriptor.base->signalSlotCount : 0;
+			for (size_t i = 0; i < descriptor.declaredSignals.size(); ++i)
+				descriptor.declaredSignals[i]->slot = firstSlot + i;
+			descriptor.signalSlotCount = firstSlot + descriptor.declaredSignals.size();
+
+			std::vector<ClassDescriptor*>::iterator end = descriptor.derivedClasses.end();
+			for (std::vector<ClassDescriptor*>::iterator iter = descriptor.derivedClasses.begin(); iter != end; ++iter)
+				nextId = number(**iter, nextId);
+
+			descriptor.lastDerivedId = nextId - 1;
+			return nextId;
 		}
 
 		ClassDescriptor::~ClassDescriptor()
@@ -47,6 +86,41 @@ namespace RBX
 			return this != &other;
 		}
 
+		bool ClassDescriptor::isA(const char* name) const
+		{
+			for (const ClassDescriptor* p = this; p != NULL; p = p->base)
+			{
+				if (p->name == name)
+					return true;
+			}
+
+			return false;
+		}
+
+		bool ClassDescriptor::isBaseOf(const char* name) const
+		{
+			if (this->name == name)
+				return true;
+
+			for (std::vector<ClassDescriptor*>::const_iterator iter = derivedClasses.begin(); iter != derivedClasses.end(); ++iter)
+			{
+				if ((*iter)->isBaseOf(name))
+					return true;
+			}
+
+			return false;
+		}
+
+		std::vector<ClassDescriptor*>::const_iterator ClassDescriptor::derivedClasses_begin() const
+		{
+			return derivedClasses.begin();
+		}
+
+		std::vector<ClassDescriptor*>::const_iterator ClassDescriptor::derivedClasses_end() const
+		{
+			return derivedClasses.end();
+		}
+
 		bool MemberDescriptor::isMemberOf(const ClassDescriptor& classDescriptor) const
 		{
 			const ClassDescriptor* p = &classDescriptor;
@@ -23,6 +23,16 @@ namespace RBX
 			classDescriptor.PropertyContainer::declare(this);
 		}
 
+		bool PropertyDescriptor::isPublic() const
+		{
+			return bIsPublic;
+		}
+
+		bool PropertyDescriptor::canStreamWrite() const
+		{
+			return bCanStreamWrite;
+		}
+
 		std::vector<const EnumDescriptor*>& EnumDescriptor::allEnums()
 		{
 			static std::vector<const EnumDescriptor*> s;
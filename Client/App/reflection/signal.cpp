@@ -1,5 +1,6 @@
 #include "reflection/signal.h"
 #include "reflection/object.h"
+#include "util/Memory.h"
 
 namespace RBX
 {
@@ -8,42 +9,57 @@ namespace RBX
 		SignalDescriptor::SignalDescriptor(ClassDescriptor& classDescriptor, const char* name)
 			: MemberDescriptor(classDescriptor, name, "Signals"),
 			  signalCreatedHook(NULL),
-			  signature()
+			  signature(),
+			  slot(0)
 		{
 			classDescriptor.SignalContainer::declare(this);
+			classDescriptor.declareSignalSlot(this);
 		}
 
 		SignalInstance* SignalDescriptor::findSignalInstance(const SignalSource* source) const
 		{
-			if (!source)
+			if (!source || !source->signals || slot >= source->signals->size())
 				return NULL;
 
-			if (!source->signals)
-				return NULL;
-
-			std::map<const SignalDescriptor*, boost::shared_ptr<SignalInstance>>::const_iterator iter = source->signals->find(this);
-			if (iter == source->signals->end())
-				return NULL;
-
-			return iter->second.get();
+			return (*source->signals)[slot].get();
 		}
 
 		boost::shared_ptr<SignalInstance> SignalDescriptor::getSignalInstance(SignalSource& source) const
 		{
 			if (!source.signals)
-				source.signals.reset(new std::map<const SignalDescriptor*, boost::shared_ptr<SignalInstance>>());
+				source.signals.reset(new std::vector<boost::shared_ptr<SignalInstance>>(owner.getSignalSlotCount()));
+
+			if (slot >= source.signals->size())
+				source.signals->resize(slot + 1);
 
-			std::map<const SignalDescriptor*, boost::shared_ptr<SignalInstance>>::iterator iter = source.signals->find(this);
-			if (iter != source.signals->end())
-				return iter->second;
+			boost::shared_ptr<SignalInstance>& stored = (*source.signals)[slot];
+			if (stored)
+				return stored;
 
-			boost::shared_ptr<SignalInstance> signalInstance(newSignalInstance(source));
-			(*source.signals)[this] = signalInstance;
+			stored.reset(newSignalInstance(source));
+
+			// the hook may connect to signals of a derived class and grow the vector, so
+			// don't hold on to the element across it
+			boost::shared_ptr<SignalInstance> signalInstance = stored;
 
 			if (signalCreatedHook)
 				signalCreatedHook(&source);
 
 			return signalInstance;
 		}
+
+		size_t SignalSource::getSignalBytes() const
+		{
+			if (!signals)
+				return 0;
+
+			size_t bytes = sizeof(*signals) + signals->capacity() * sizeof(boost::shared_ptr<SignalInstance>);
+			for (size_t i = 0; i < signals->size(); ++i)
+			{
+				if ((*signals)[i])
+					bytes += Memory::blockSize(dynamic_cast<const void*>((*signals)[i].get()));
+			}
+			return bytes;
+		}
 	}
 }
@@ -0,0 +1,191 @@
+#include "util/Base64.h"
+#include "util/ContentProvider.h"
+#include <string.h>
+
+namespace RBX
+{
+	static const char encodeTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	static const signed char Whitespace = -1;
+	static const signed char Padding = -2;
+	static const signed char Invalid = -3;
+
+	class DecodeTable
+	{
+	public:
+		signed char data[256];
+
+	public:
+		DecodeTable()
+		{
+			memset(data, Invalid, sizeof(data));
+			for (int i = 0; i < 64; ++i)
+				data[(unsigned char)encodeTable[i]] = (signed char)i;
+
+			data['='] = Padding;
+			data[' '] = Whitespace;
+			data['\t'] = Whitespace;
+			data['\r'] = Whitespace;
+			data['\n'] = Whitespace;
+		}
+	};
+
+	static DecodeTable decodeTable;
+
+	Base64Decoder::Base64Decoder(std::string& out, MD5Hasher* hasher)
+		: out(out),
+		  hasher(hasher),
+		  bits(0),
+		  count(0),
+		  padded(false),
+		  failed(false),
+		  blockSize(0)
+	{
+	}
+
+	void Base64Decoder::flush()
+	{
+		if (blockSize == 0)
+			return;
+
+		out.append(block, blockSize);
+		if (hasher)
+			hasher->addData(block, blockSize);
+
+		blockSize = 0;
+	}
+
+	void Base64Decoder::decode(const char* text, size_t size)
+	{
+		const unsigned char* p = (const unsigned char*)text;
+		const unsigned char* end = p + size;
+		const signed char* table = decodeTable.data;
+
+		while (p < end)
+		{
+			// whole groups: no whitespace, no padding, nothing carried over
+			if (count == 0 && !padded)
+			{
+				while (end - p >= 4)
+				{
+					int a = table[p[0]];
+					int b = table[p[1]];
+					int c = table[p[2]];
+					int d = table[p[3]];
+					if ((a | b | c | d) < 0)
+						break;
+
+					if (blockSize > sizeof(block) - 3)
+						flush();
+
+					unsigned int group = (a << 18) | (b << 12) | (c << 6) | d;
+					block[blockSize++] = (char)(group >> 16);
+					block[blockSize++] = (char)(group >> 8);
+					block[blockSize++] = (char)group;
+					p += 4;
+				}
+
+				if (p == end)
+					break;
+			}
+
+			// one character at a time until the groups line up again
+			int value = table[*p++];
+			if (value == Whitespace)
+				continue;
+
+			if (value == Padding)
+			{
+				padded = true;
+				continue;
+			}
+
+			if (value == Invalid || padded)
+			{
+				failed = true;
+				continue;
+			}
+
+			bits = (bits << 6) | value;
+			if (++count == 4)
+			{
+				if (blockSize > sizeof(block) - 3)
+					flush();
+
+				block[blockSize++] = (char)(bits >> 16);
+				block[blockSize++] = (char)(bits >> 8);
+				block[blockSize++] = (char)bits;
+				bits = 0;
+				count = 0;
+			}
+		}
+	}
+
+	bool Base64Decoder::finish()
+	{
+		if (blockSize > sizeof(block) - 3)
+			flush();
+
+		switch (count)
+		{
+		case 2:
+			block[blockSize++] = (char)(bits >> 4);
+			break;
+		case 3:
+			block[blockSize++] = (char)(bits >> 10);
+			block[blockSize++] = (char)(bits >> 2);
+			break;
+		case 1:
+			failed = true;
+			break;
+		}
+
+		bits = 0;
+		count = 0;
+		flush();
+
+		return !failed;
+	}
+
+	void base64Encode(const char* data, size_t size, std::ostream& out)
+	{
+		const unsigned char* p = (const unsigned char*)data;
+		const unsigned char* end = p + size;
+
+		char line[73];
+		size_t lineSize = 0;
+		int groups = 0;
+
+		while (end - p >= 3)
+		{
+			unsigned int group = (p[0] << 16) | (p[1] << 8) | p[2];
+			line[lineSize++] = encodeTable[group >> 18];
+			line[lineSize++] = encodeTable[(group >> 12) & 0x3f];
+			line[lineSize++] = encodeTable[(group >> 6) & 0x3f];
+			line[lineSize++] = encodeTable[group & 0x3f];
+			p += 3;
+
+			if (++groups == 18)
+			{
+				line[lineSize++] = '\n';
+				out.write(line, (std::streamsize)lineSize);
+				lineSize = 0;
+				groups = 0;
+			}
+		}
+
+		if (p < end)
+		{
+			unsigned int group = p[0] << 16;
+			if (end - p == 2)
+				group |= p[1] << 8;
+
+			line[lineSize++] = encodeTable[group >> 18];
+			line[lineSize++] = encodeTable[(group >> 12) & 0x3f];
+			line[lineSize++] = end - p == 2 ? encodeTable[(group >> 6) & 0x3f] : '=';
+			line[lineSize++] = '=';
+		}
+
+		out.write(line, (std::streamsize)lineSize);
+	}
+}
@@ -0,0 +1,439 @@
+#include "util/ContentCache.h"
+#include "util/ContentProvider.h"
+#include "util/standardout.h"
+#include <windows.h>
+#include <boost/scoped_ptr.hpp>
+#include <G3D/format.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace RBX
+{
+	static const char* indexFileName = "index.txt";
+
+	// bookkeeping per memory entry on top of the data itself
+	static const size_t entryOverhead = 64;
+
+	// stale index lines tolerated on top of two per live entry before the index is rewritten
+	static const size_t indexSlack = 64;
+
+	static std::string hashData(const std::string& data)
+	{
+		boost::scoped_ptr<MD5Hasher> hasher(MD5Hasher::create());
+		hasher->addData(data);
+		return hasher->toString();
+	}
+
+	static bool fileSize(const std::string& path, size_t& bytes)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA data;
+		if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+			return false;
+
+		bytes = (size_t)data.nFileSizeLow;
+		return true;
+	}
+
+	ContentCache::ContentCache(size_t maxBytes, size_t maxDiskBytes)
+		: maxBytes(maxBytes),
+		  maxDiskBytes(maxDiskBytes),
+		  indexLines(0)
+	{
+	}
+
+	void ContentCache::setMaxBytes(size_t value)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		maxBytes = value;
+		evict();
+	}
+
+	void ContentCache::setMaxDiskBytes(size_t value)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		maxDiskBytes = value;
+		evictDisk();
+		compactIndex();
+	}
+
+	std::string ContentCache::diskPath(const std::string& hash) const
+	{
+		return diskFolder + "\\" + hash;
+	}
+
+	void ContentCache::setDiskFolder(const std::string& folder)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+
+		diskFolder = folder;
+		diskIndex.clear();
+		diskLru.clear();
+		diskFiles.clear();
+		statistics.diskBytes = 0;
+		indexLines = 0;
+
+		if (diskFolder.empty())
+			return;
+
+		// one "<hash> <id>" line per entry, least recently used first; later lines win
+		{
+			std::ifstream index((diskFolder + "\\" + indexFileName).c_str());
+			std::string line;
+			while (std::getline(index, line))
+			{
+				size_t space = line.find(' ');
+				if (space == std::string::npos || space == 0 || space + 1 >= line.size())
+					continue;
+
+				std::string hash = line.substr(0, space);
+				std::string id = line.substr(space + 1);
+
+				// a file is looked at again once it is no longer tracked; a remapped id may have removed it
+				size_t bytes;
+				DiskFiles::const_iterator file = diskFiles.find(hash);
+				if (file != diskFiles.end())
+					bytes = file->second->bytes;
+				else if (!fileSize(diskPath(hash), bytes))
+				{
+					dropDiskId(id);
+					continue;
+				}
+
+				addDiskEntry(id, hash, bytes);
+			}
+		}
+
+		evictDisk();
+		writeIndex();
+	}
+
+	void ContentCache::addDiskEntry(const std::string& id, const std::string& hash, size_t bytes)
+	{
+		DiskIndex::const_iterator iter = diskIndex.find(id);
+		if (iter != diskIndex.end())
+		{
+			if (iter->second == hash)
+			{
+				touchDisk(hash);
+				return;
+			}
+			dropDiskId(id);
+		}
+
+		DiskFiles::iterator file = diskFiles.find(hash);
+		if (file == diskFiles.end())
+		{
+			DiskFile diskFile;
+			diskFile.hash = hash;
+			diskFile.bytes = bytes;
+			diskLru.push_front(diskFile);
+			file = diskFiles.insert(std::make_pair(hash, diskLru.begin())).first;
+			statistics.diskBytes += bytes;
+		}
+		else
+			diskLru.splice(diskLru.begin(), diskLru, file->second);
+
+		file->second->ids.push_back(id);
+		diskIndex[id] = hash;
+	}
+
+	void ContentCache::touchDisk(const std::string& hash)
+	{
+		DiskFiles::iterator file = diskFiles.find(hash);
+		if (file != diskFiles.end())
+			diskLru.splice(diskLru.begin(), diskLru, file->second);
+	}
+
+	void ContentCache::dropDiskId(const std::string& id)
+	{
+		DiskIndex::iterator iter = diskIndex.find(id);
+		if (iter == diskIndex.end())
+			return;
+
+		DiskFiles::iterator file = diskFiles.find(iter->second);
+		diskIndex.erase(iter);
+
+		if (file == diskFiles.end())
+			return;
+
+		std::vector<std::string>& ids = file->second->ids;
+		ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+
+		// nothing refers to the content any more
+		if (ids.empty())
+			removeDiskFile(file);
+	}
+
+	void ContentCache::removeDiskFile(DiskFiles::iterator file)
+	{
+		DiskLru::iterator node = file->second;
+
+		for (size_t i = 0; i < node->ids.size(); ++i)
+			diskIndex.erase(node->ids[i]);
+
+		remove(diskPath(node->hash).c_str());
+		statistics.diskBytes -= node->bytes;
+
+		diskFiles.erase(file);
+		diskLru.erase(node);
+	}
+
+	void ContentCache::evictDisk()
+	{
+		// the newest file always stays, even when it alone is over the limit
+		while (statistics.diskBytes > maxDiskBytes && diskLru.size() > 1)
+		{
+			removeDiskFile(diskFiles.find(diskLru.back().hash));
+			++statistics.diskEvictions;
+		}
+	}
+
+	bool ContentCache::find(const std::string& id, Entry& entry)
+	{
+		std::string hash;
+		std::string path;
+		{
+			boost::mutex::scoped_lock lock(mutex);
+
+			MemoryIndex::iterator iter = memoryIndex.find(id);
+			if (iter != memoryIndex.end())
+			{
+				lru.splice(lru.begin(), lru, iter->second);
+				entry = iter->second->entry;
+				++statistics.hits;
+				return true;
+			}
+
+			DiskIndex::const_iterator diskIter = diskIndex.find(id);
+			if (diskIter == diskIndex.end())
+			{
+				++statistics.misses;
+				return false;
+			}
+
+			hash = diskIter->second;
+			path = diskPath(hash);
+		}
+
+		// read outside of the lock; other lookups shouldn't wait on the disk
+		std::ifstream file(path.c_str(), std::ios_base::in | std::ios_base::binary);
+		if (!file)
+		{
+			boost::mutex::scoped_lock lock(mutex);
+
+			DiskIndex::const_iterator iter = diskIndex.find(id);
+			if (iter != diskIndex.end() && iter->second == hash)
+			{
+				DiskFiles::iterator diskFile = diskFiles.find(hash);
+				if (diskFile != diskFiles.end())
+					removeDiskFile(diskFile);
+				writeIndex();
+			}
+
+			++statistics.misses;
+			return false;
+		}
+
+		std::ostringstream contents;
+		contents << file.rdbuf();
+		file.close();
+
+		boost::shared_ptr<const std::string> data(new std::string(contents.str()));
+
+		// a file that was cut short or damaged no longer matches the hash it is named after
+		if (hashData(*data) != hash)
+		{
+			StandardOut::singleton()->print(MESSAGE_WARNING, "ContentCache: dropping corrupt %s", path.c_str());
+
+			boost::mutex::scoped_lock lock(mutex);
+
+			// every id naming this hash shares the damaged file
+			DiskFiles::iterator diskFile = diskFiles.find(hash);
+			if (diskFile != diskFiles.end())
+			{
+				removeDiskFile(diskFile);
+				writeIndex();
+			}
+			else
+				remove(path.c_str());
+
+			++statistics.misses;
+			return false;
+		}
+
+		entry.data = data;
+		entry.filename.reset(new std::string(path));
+
+		boost::mutex::scoped_lock lock(mutex);
+		touchDisk(hash);
+		insertMemory(id, entry);
+		++statistics.diskHits;
+		return true;
+	}
+
+	bool ContentCache::contains(const std::string& id) const
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		return memoryIndex.find(id) != memoryIndex.end() || diskIndex.find(id) != diskIndex.end();
+	}
+
+	void ContentCache::insert(const std::string& id, const boost::shared_ptr<const std::string>& data)
+	{
+		Entry entry;
+		entry.data = data;
+
+		std::string folder;
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			folder = diskFolder;
+		}
+
+		std::string hash;
+		if (!folder.empty() && data)
+		{
+			hash = hashData(*data);
+
+			std::string path = folder + "\\" + hash;
+
+			// content addressed: identical content under another id is already there
+			std::ifstream existing(path.c_str(), std::ios_base::in | std::ios_base::binary);
+			if (!existing)
+			{
+				// written to a file of its own and moved into place, so a crash or another thread
+				// never leaves a partial file under the hash
+				std::string temp = G3D::format("%s.%u.tmp", path.c_str(), (unsigned int)GetCurrentThreadId());
+
+				bool written;
+				{
+					std::ofstream file(temp.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+					file.write(data->data(), (std::streamsize)data->size());
+					file.close();
+					written = !file.fail();
+				}
+
+				if (!written || !MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+				{
+					StandardOut::singleton()->print(MESSAGE_WARNING, "ContentCache: failed to write %s", path.c_str());
+					DeleteFileA(temp.c_str());
+					hash.clear();
+				}
+			}
+
+			if (!hash.empty())
+				entry.filename.reset(new std::string(path));
+		}
+
+		boost::mutex::scoped_lock lock(mutex);
+
+		if (!hash.empty() && folder == diskFolder)
+		{
+			DiskIndex::const_iterator iter = diskIndex.find(id);
+			bool changed = iter == diskIndex.end() || iter->second != hash;
+
+			addDiskEntry(id, hash, data->size());
+			if (changed)
+				appendIndex(id, hash);
+
+			evictDisk();
+			compactIndex();
+		}
+
+		insertMemory(id, entry);
+	}
+
+	void ContentCache::insertMemory(const std::string& id, const Entry& entry)
+	{
+		MemoryIndex::iterator iter = memoryIndex.find(id);
+		if (iter != memoryIndex.end())
+		{
+			statistics.bytes -= iter->second->bytes;
+			lru.erase(iter->second);
+			memoryIndex.erase(iter);
+		}
+
+		Node node;
+		node.id = id;
+		node.entry = entry;
+		node.bytes = (entry.data ? entry.data->size() : 0) + id.size() + entryOverhead;
+
+		lru.push_front(node);
+		memoryIndex[id] = lru.begin();
+		statistics.bytes += node.bytes;
+
+		evict();
+	}
+
+	void ContentCache::evict()
+	{
+		// the newest entry always stays, even when it alone is over the limit
+		while (statistics.bytes > maxBytes && lru.size() > 1)
+		{
+			Node& oldest = lru.back();
+			statistics.bytes -= oldest.bytes;
+			memoryIndex.erase(oldest.id);
+			lru.pop_back();
+			++statistics.evictions;
+		}
+	}
+
+	void ContentCache::clearMemory()
+	{
+		boost::mutex::scoped_lock lock(mutex);
+
+		lru.clear();
+		memoryIndex.clear();
+		statistics.bytes = 0;
+	}
+
+	void ContentCache::clearDisk()
+	{
+		boost::mutex::scoped_lock lock(mutex);
+
+		if (diskFolder.empty())
+			return;
+
+		for (DiskLru::const_iterator iter = diskLru.begin(); iter != diskLru.end(); ++iter)
+			remove(diskPath(iter->hash).c_str());
+
+		diskIndex.clear();
+		diskLru.clear();
+		diskFiles.clear();
+		statistics.diskBytes = 0;
+		writeIndex();
+	}
+
+	void ContentCache::appendIndex(const std::string& id, const std::string& hash)
+	{
+		std::ofstream index((diskFolder + "\\" + indexFileName).c_str(), std::ios_base::out | std::ios_base::app);
+		index << hash << ' ' << id << '\n';
+		++indexLines;
+	}
+
+	void ContentCache::compactIndex()
+	{
+		// evictions and remapped ids leave lines behind; drop them once they outnumber the live ones
+		if (!diskFolder.empty() && indexLines > 2 * diskIndex.size() + indexSlack)
+			writeIndex();
+	}
+
+	void ContentCache::writeIndex()
+	{
+		// oldest first, so reading it back in order restores the recency of the files
+		std::ofstream index((diskFolder + "\\" + indexFileName).c_str(), std::ios_base::out | std::ios_base::trunc);
+		for (DiskLru::const_reverse_iterator iter = diskLru.rbegin(); iter != diskLru.rend(); ++iter)
+			for (size_t i = 0; i < iter->ids.size(); ++i)
+				index << iter->hash << ' ' << iter->ids[i] << '\n';
+
+		indexLines = diskIndex.size();
+	}
+
+	ContentCache::Statistics ContentCache::getStatistics() const
+	{
+		boost::mutex::scoped_lock lock(mutex);
+
+		Statistics result = statistics;
+		result.entries = lru.size();
+		return result;
+	}
+}
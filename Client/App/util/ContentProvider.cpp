@@ -1,8 +1,12 @@
 #include "util/ContentProvider.h"
 #include "util/standardout.h"
 #include "util/Http.h"
+#include "util/Debug.h"
 #include <atlutil.h>
 #include <boost/shared_ptr.hpp>
+#include <boost/bind.hpp>
+#include <algorithm>
+#include <cctype>
 
 namespace RBX
 {
@@ -18,6 +22,305 @@ namespace RBX
 		return sing;
 	}
 
+	static const int defaultFetchWorkers = 4;
+	static const int defaultRequestsPerHost = 2;
+	static const size_t defaultContentCacheBytes = 64 * 1024 * 1024;
+	static const size_t defaultContentCacheDiskBytes = 512 * 1024 * 1024;
+	static const int failedUrlRetrySeconds = 60;
+
+	ContentProvider::ContentProvider()
+		: maxRequestsPerHost(defaultRequestsPerHost),
+		  contentCache(defaultContentCacheBytes, defaultContentCacheDiskBytes)
+	{
+		setFetchWorkerCount(defaultFetchWorkers);
+	}
+
+	ContentProvider::~ContentProvider()
+	{
+		// ends the workers, waiting for them to finish what they are fetching
+		setFetchWorkerCount(0);
+	}
+
+	bool ContentFuture::isReady() const
+	{
+		boost::mutex::scoped_lock lock(sync);
+		return ready;
+	}
+
+	boost::shared_ptr<const std::string> ContentFuture::wait()
+	{
+		boost::mutex::scoped_lock lock(sync);
+		while (!ready)
+			readyCondition.wait(lock);
+
+		return data;
+	}
+
+	boost::shared_ptr<const std::string> ContentFuture::getData() const
+	{
+		boost::mutex::scoped_lock lock(sync);
+		RBXASSERT(ready);
+		return data;
+	}
+
+	std::string ContentFuture::getError() const
+	{
+		boost::mutex::scoped_lock lock(sync);
+		return error;
+	}
+
+	void ContentFuture::complete(const boost::shared_ptr<const std::string>& data, const std::string& error)
+	{
+		boost::mutex::scoped_lock lock(sync);
+		RBXASSERT(!ready);
+
+		this->data = data;
+		this->error = error;
+		ready = true;
+		readyCondition.notify_all();
+	}
+
+	static bool endsWith(const std::string& s, const char* suffix)
+	{
+		size_t length = strlen(suffix);
+		return s.size() >= length && s.compare(s.size() - length, length, suffix) == 0;
+	}
+
+	ContentProvider::RequestPriority ContentProvider::priorityOf(const ContentId& id)
+	{
+		const std::string& mimeType = id.mimeType().toString();
+		if (mimeType.find("script") != std::string::npos)
+			return ScriptPriority;
+		if (mimeType.find("mesh") != std::string::npos)
+			return MeshPriority;
+		if (mimeType.find("image/") == 0)
+			return TexturePriority;
+		if (mimeType.find("audio/") == 0)
+			return SoundPriority;
+
+		std::string path = id.toString().substr(0, id.toString().find('?'));
+		std::transform(path.begin(), path.end(), path.begin(), ::tolower);
+
+		if (endsWith(path, ".lua") || endsWith(path, ".rbxs"))
+			return ScriptPriority;
+		if (endsWith(path, ".mesh"))
+			return MeshPriority;
+		if (endsWith(path, ".png") || endsWith(path, ".jpg") || endsWith(path, ".jpeg") || endsWith(path, ".bmp") || endsWith(path, ".tga") || endsWith(path, ".dds"))
+			return TexturePriority;
+		if (endsWith(path, ".wav") || endsWith(path, ".mp3") || endsWith(path, ".ogg") || endsWith(path, ".mid"))
+			return SoundPriority;
+
+		return DefaultPriority;
+	}
+
+	std::string ContentProvider::hostOf(const std::string& url)
+	{
+		if (!isHttpUrl(url))
+			return std::string();
+
+		size_t start = url.find("://") + 3;
+		size_t end = url.find_first_of("/?#", start);
+		std::string host = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+		std::transform(host.begin(), host.end(), host.begin(), ::tolower);
+		return host;
+	}
+
+	boost::shared_ptr<const std::string> ContentProvider::requestContentString(ContentId id)
+	{
+		boost::shared_ptr<ContentFuture> future = fetchContent(id);
+		return future->isReady() ? future->getData() : boost::shared_ptr<const std::string>();
+	}
+
+	boost::shared_ptr<ContentFuture> ContentProvider::fetchContent(ContentId id)
+	{
+		return fetchContent(id, priorityOf(id));
+	}
+
+	boost::shared_ptr<ContentFuture> ContentProvider::fetchContent(ContentId id, RequestPriority priority)
+	{
+		RBXASSERT(priority >= 0 && priority < PriorityCount);
+
+		boost::shared_ptr<ContentFuture> future(new ContentFuture());
+
+		if (id.isNull())
+		{
+			future->complete(boost::shared_ptr<const std::string>(), "empty ContentId");
+			return future;
+		}
+
+		CachedContent cached;
+		if (contentCache.find(id.toString(), cached) && cached.data)
+		{
+			future->complete(cached.data, std::string());
+			return future;
+		}
+
+		if (isUrlBad(id.toString().c_str()))
+		{
+			future->complete(boost::shared_ptr<const std::string>(), "recently failed to load " + id.toString());
+			return future;
+		}
+
+		{
+			boost::mutex::scoped_lock lock(requestSync);
+
+			std::map<std::string, boost::shared_ptr<ContentFuture>>::iterator iter = inFlight.find(id.toString());
+			if (iter != inFlight.end())
+			{
+				// still queued behind less urgent work? move it up
+				for (int p = priority + 1; p < PriorityCount; ++p)
+				{
+					std::list<PendingRequest>& queue = requestQueues[p];
+					for (std::list<PendingRequest>::iterator request = queue.begin(); request != queue.end(); ++request)
+					{
+						if (request->future == iter->second)
+						{
+							request->priority = priority;
+							requestQueues[priority].splice(requestQueues[priority].end(), queue, request);
+							return iter->second;
+						}
+					}
+				}
+
+				return iter->second;
+			}
+
+			PendingRequest request;
+			request.id = id;
+			request.host = hostOf(id.toString());
+			request.priority = priority;
+			request.future = future;
+
+			requestQueues[priority].push_back(request);
+			inFlight[id.toString()] = future;
+		}
+
+		wakeRequestProcessors();
+		return future;
+	}
+
+	bool ContentProvider::takeNextRequest(PendingRequest& request)
+	{
+		for (int p = 0; p < PriorityCount; ++p)
+		{
+			std::list<PendingRequest>& queue = requestQueues[p];
+			for (std::list<PendingRequest>::iterator iter = queue.begin(); iter != queue.end(); ++iter)
+			{
+				if (!iter->host.empty())
+				{
+					std::map<std::string, int>::const_iterator active = activeHostRequests.find(iter->host);
+					if (active != activeHostRequests.end() && active->second >= maxRequestsPerHost)
+						continue;
+				}
+
+				request = *iter;
+				queue.erase(iter);
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	worker_thread::work_result ContentProvider::processRequests()
+	{
+		PendingRequest request;
+		{
+			boost::mutex::scoped_lock lock(requestSync);
+			if (!takeNextRequest(request))
+				return worker_thread::done;
+
+			if (!request.host.empty())
+				++activeHostRequests[request.host];
+		}
+
+		boost::shared_ptr<const std::string> data;
+		std::string error;
+		try
+		{
+			CachedContent content;
+			if (loadContent(request.id, AsyncHttpRequest) && contentCache.find(request.id.toString(), content))
+				data = content.data;
+			else
+				error = "failed to load " + request.id.toString();
+		}
+		catch (std::exception& e)
+		{
+			error = e.what();
+		}
+
+		if (!data && isHttpUrl(request.id.toString()))
+			markUrlBad(request.id.toString());
+
+		{
+			boost::mutex::scoped_lock lock(requestSync);
+
+			if (!request.host.empty())
+			{
+				std::map<std::string, int>::iterator active = activeHostRequests.find(request.host);
+				RBXASSERT(active != activeHostRequests.end());
+				if (--active->second == 0)
+					activeHostRequests.erase(active);
+			}
+
+			inFlight.erase(request.id.toString());
+		}
+
+		request.future->complete(data, error);
+
+		// a host slot just freed up, which may unblock requests other workers passed over
+		wakeRequestProcessors();
+		return worker_thread::more;
+	}
+
+	void ContentProvider::wakeRequestProcessors()
+	{
+		boost::mutex::scoped_lock lock(requestSync);
+		for (size_t i = 0; i < requestProcessors.size(); ++i)
+			requestProcessors[i]->wake();
+	}
+
+	void ContentProvider::setFetchWorkerCount(int count)
+	{
+		RBXASSERT(count >= 0);
+
+		std::vector<boost::shared_ptr<worker_thread>> stopped;
+
+		{
+			boost::mutex::scoped_lock lock(requestSync);
+
+			while ((int)requestProcessors.size() > count)
+			{
+				stopped.push_back(requestProcessors.back());
+				requestProcessors.pop_back();
+			}
+
+			while ((int)requestProcessors.size() < count)
+				requestProcessors.push_back(boost::shared_ptr<worker_thread>(new worker_thread(boost::bind(&ContentProvider::processRequests, this), "rbx_contentprovider")));
+		}
+
+		// joined without the lock, which a worker finishing its fetch takes on the way out
+		for (size_t i = 0; i < stopped.size(); ++i)
+			stopped[i]->join();
+	}
+
+	int ContentProvider::getFetchWorkerCount() const
+	{
+		return (int)requestProcessors.size();
+	}
+
+	void ContentProvider::setMaxRequestsPerHost(int count)
+	{
+		RBXASSERT(count > 0);
+
+		{
+			boost::mutex::scoped_lock lock(requestSync);
+			maxRequestsPerHost = count;
+		}
+
+		wakeRequestProcessors();
+	}
+
 	bool ContentProvider::isHttpUrl(const std::string& s)
 	{
 		if (s.find("http://", 0, 7) == 0)
@@ -34,10 +337,95 @@ namespace RBX
 		return assetFolderPath;
 	}
 
+	ContentId ContentProvider::registerContent(std::istream& content, const Name& mimeType)
+	{
+		boost::scoped_ptr<MD5Hasher> hasher(MD5Hasher::create());
+
+		std::string* data = new std::string();
+		boost::shared_ptr<const std::string> shared(data);
+
+		char buffer[4096];
+		do
+		{
+			content.read(buffer, sizeof(buffer));
+			data->append(buffer, (size_t)content.gcount());
+			hasher->addData(buffer, (size_t)content.gcount());
+		}
+		while (content.gcount() > 0);
+
+		return registerContent(shared, hasher->toString(), mimeType);
+	}
+
+	ContentId ContentProvider::registerContent(const boost::shared_ptr<const std::string>& data, const std::string& hash, const Name& mimeType)
+	{
+		ContentId id(ContentId::fromMD5Hash(hash).toString(), mimeType);
+		contentCache.insert(id.toString(), data);
+		return id;
+	}
+
+	bool ContentProvider::isUrlBad(const char* url)
+	{
+		boost::mutex::scoped_lock lock(requestSync);
+
+		stdext::hash_map<std::string, boost::posix_time::ptime>::iterator iter = failedUrls.find(url);
+		if (iter == failedUrls.end())
+			return false;
+
+		if (boost::posix_time::second_clock::universal_time() < iter->second)
+			return true;
+
+		failedUrls.erase(iter);
+		return false;
+	}
+
+	void ContentProvider::markUrlBad(const std::string& url)
+	{
+		boost::mutex::scoped_lock lock(requestSync);
+		failedUrls[url] = boost::posix_time::second_clock::universal_time() + boost::posix_time::seconds(failedUrlRetrySeconds);
+	}
+
+	bool ContentProvider::hasContent(ContentId id)
+	{
+		return contentCache.contains(id.toString());
+	}
+
+	void ContentProvider::clearContentCache()
+	{
+		contentCache.clearMemory();
+
+		boost::mutex::scoped_lock lock(requestSync);
+		failedUrls.clear();
+	}
+
+	void ContentProvider::clearFileCache()
+	{
+		contentCache.clearDisk();
+	}
+
+	void ContentProvider::setContentCacheLimit(size_t bytes)
+	{
+		contentCache.setMaxBytes(bytes);
+	}
+
+	void ContentProvider::setContentCacheDiskLimit(size_t bytes)
+	{
+		contentCache.setMaxDiskBytes(bytes);
+	}
+
+	void ContentProvider::setContentCacheFolder(const char* folder)
+	{
+		contentCache.setDiskFolder(folder ? folder : "");
+	}
+
+	ContentCache::Statistics ContentProvider::getContentCacheStatistics() const
+	{
+		return contentCache.getStatistics();
+	}
+
 	bool ContentProvider::isRequestQueueEmpty()
 	{
 		boost::mutex::scoped_lock lock(requestSync);
-		return requestQueue.empty();
+		return inFlight.empty();
 	}
 
 	class MD5HasherImpl : public MD5Hasher
@@ -66,6 +454,10 @@ namespace RBX
 		}
 		~MD5HasherImpl()
 		{
+			if (hHash)
+				CryptDestroyHash(hHash);
+			if (hProv)
+				CryptReleaseContext(hProv, 0);
 		}
 
 	public:
@@ -112,8 +504,8 @@ namespace RBX
 					StandardOut::singleton()->print(MESSAGE_ERROR, "Error during CryptGetHashParam. GetLastError = %d", GetLastError());
 				}
 
-				char* hashValue = new char[hashSize];
-				if (!CryptGetHashParam(hHash, HP_HASHVAL, (BYTE*)&hashValue, &hashSize, 0))
+				unsigned char* hashValue = new unsigned char[hashSize];
+				if (!CryptGetHashParam(hHash, HP_HASHVAL, hashValue, &hashSize, 0))
 				{
 					StandardOut::singleton()->print(MESSAGE_ERROR, "Error during CryptGetHashParam. GetLastError = %d", GetLastError());
 				}
@@ -121,7 +513,7 @@ namespace RBX
 				for (int i = 0; i < (int)hashSize; ++i)
 				{
 					ATL::CString temp;
-					temp.Format("%x", hashValue[i]);
+					temp.Format("%02x", hashValue[i]);
 					result += temp.GetString();
 				}
 
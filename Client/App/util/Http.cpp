@@ -4,8 +4,10 @@
 #include <atlutil.h>
 #include <wininet.h>
 #include <sstream>
+#include <map>
 #include <G3D/format.h>
 #include <boost/scoped_ptr.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/copy.hpp>
@@ -74,8 +76,90 @@ namespace RBX
 		}
 	}
 
-	template<bool isPost>
-	static void httpGetPost(const std::string& url, std::istream& data, bool compressData, const char* additionalHeaders, std::string& response)
+	// Closes a WinINet handle when it goes out of scope, including when a request throws
+	class InternetHandle : public boost::noncopyable
+	{
+	private:
+		HINTERNET handle;
+
+	public:
+		InternetHandle(HINTERNET handle)
+			: handle(handle)
+		{
+		}
+		~InternetHandle()
+		{
+			if (handle)
+				InternetCloseHandle(handle);
+		}
+
+		operator HINTERNET() const
+		{
+			return handle;
+		}
+	};
+
+	// One WinINet session for the process and one connection handle per server.
+	// WinINet only keeps a server's sockets alive (INTERNET_FLAG_KEEP_CONNECTION) while a handle to
+	// it is open, so closing everything after each request paid for a new TCP connection every time.
+	// Connection handles are safe to share between threads; concurrent requests through one handle
+	// each get a socket of their own, up to maxConnectionsPerServer.
+	class ConnectionPool
+	{
+	private:
+		static const DWORD maxConnectionsPerServer = 6;
+
+		boost::mutex mutex;
+		HINTERNET session;
+		std::map<std::string, HINTERNET> connections;
+
+	public:
+		ConnectionPool()
+			: session(NULL)
+		{
+		}
+
+		HINTERNET getConnection(ATL::CUrl& crack)
+		{
+			std::string key = G3D::format("%s:%d@%s", crack.GetHostName(), (int)crack.GetPortNumber(), crack.GetUserNameA());
+
+			boost::mutex::scoped_lock lock(mutex);
+
+			std::map<std::string, HINTERNET>::iterator iter = connections.find(key);
+			if (iter != connections.end())
+				return iter->second;
+
+			if (!session)
+			{
+				session = InternetOpenA("Roblox", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+				ThrowIfFailure(session != NULL, "InternetOpen failed");
+
+				DWORD maxConnections = maxConnectionsPerServer;
+				InternetSetOptionA(session, INTERNET_OPTION_MAX_CONNS_PER_SERVER, &maxConnections, sizeof(maxConnections));
+				InternetSetOptionA(session, INTERNET_OPTION_MAX_CONNS_PER_1_0_SERVER, &maxConnections, sizeof(maxConnections));
+			}
+
+			HINTERNET connection = InternetConnectA(session,
+				crack.GetHostName(),
+				crack.GetPortNumber(),
+				crack.GetUserNameA(),
+				crack.GetPassword(),
+				INTERNET_SERVICE_HTTP,
+				0,
+				TRUE);
+			ThrowIfFailure(connection != NULL, "InternetConnect failed");
+
+			connections[key] = connection;
+			return connection;
+		}
+	};
+
+	static ConnectionPool connectionPool;
+
+	// The response body is written to sink as it arrives, so callers that stream it don't need a
+	// copy of the whole body. Fails before writing anything when the status isn't 200
+	template<bool isPost, typename Sink>
+	static void httpGetPost(const std::string& url, std::istream& data, bool compressData, const char* additionalHeaders, Sink& response)
 	{
 		if (url.size() == 0)
 			throw std::runtime_error("empty url");
@@ -89,22 +173,13 @@ namespace RBX
 		if (crack.GetHostNameLength() == 0)
 			throw std::runtime_error(G3D::format("'%s' is missing a hostName", url.c_str()));
 
-		HINTERNET session = InternetOpenA("Roblox", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
-
-		HINTERNET connection = InternetConnectA(session,
-			crack.GetHostName(),
-			crack.GetPortNumber(),
-			crack.GetUserNameA(),
-			crack.GetPassword(),
-			INTERNET_SERVICE_HTTP,
-			0,
-			TRUE);
+		HINTERNET connection = connectionPool.getConnection(crack);
 
 		{
 			ATL::CString s = crack.GetUrlPath();
 			s += crack.GetExtraInfo();
 
-			HINTERNET request = HttpOpenRequestA(
+			InternetHandle request(HttpOpenRequestA(
 				connection,
 				isPost ? "POST" : "GET",
 				s.GetString(),
@@ -112,7 +187,7 @@ namespace RBX
 				NULL,
 				NULL,
 				INTERNET_FLAG_EXISTING_CONNECT | INTERNET_FLAG_KEEP_CONNECTION | INTERNET_FLAG_NEED_FILE,
-				TRUE);
+				TRUE));
 
 			if (!request)
 				throw std::runtime_error(G3D::format("HttpOpenRequest failed for %s", url.c_str()));
@@ -181,6 +256,9 @@ namespace RBX
 					statusCode = atol(buffer);
 				}
 
+				if (statusCode != 200)
+					throw std::runtime_error(G3D::format("statusCode = %d", statusCode));
+
 				{
 					boost::iostreams::filtering_stream<boost::iostreams::input> in;
 
@@ -193,20 +271,13 @@ namespace RBX
 					}
 
 					in.push(HttpRequest_source(request));
-					boost::iostreams::copy(in, String_sink(response));
+					boost::iostreams::copy(in, response);
 				}
-
-				if (statusCode != 200)
-					throw std::runtime_error(G3D::format("statusCode = %d", statusCode));
 			}
-
-			InternetCloseHandle(request);
 		}
-
-		InternetCloseHandle(connection);
-		InternetCloseHandle(session);
 	}
 
+
 	bool Http::isScript(const char* url)
 	{
 		ATL::CUrl crack;
@@ -285,6 +356,17 @@ namespace RBX
 	}
 
 	void Http::get(std::string& response)
+	{
+		const char* h = NULL;
+		if (!additionalHeaders.empty())
+			h = additionalHeaders.c_str();
+
+		String_sink sink(response);
+		std::istringstream dummy;
+		httpGetPost<false>(url, dummy, false, h, sink);
+	}
+
+	void Http::get(std::ostream& response)
 	{
 		const char* h = NULL;
 		if (!additionalHeaders.empty())
@@ -295,6 +377,15 @@ namespace RBX
 	}
 
 	void Http::post(std::istream& input, bool compress, std::string& response)
+	{
+		String_sink sink(response);
+		if (additionalHeaders.empty())
+			httpGetPost<true>(url, input, compress, NULL, sink);
+		else
+			httpGetPost<true>(url, input, compress, additionalHeaders.c_str(), sink);
+	}
+
+	void Http::post(std::istream& input, bool compress, std::ostream& response)
 	{
 		if (additionalHeaders.empty())
 			httpGetPost<true>(url, input, compress, NULL, response);
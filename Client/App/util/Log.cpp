@@ -1,14 +1,14 @@
 #define _CRT_SECURE_NO_DEPRECATE
 #include "util/Log.h"
+#include "util/boost.hpp"
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
 #include <windows.h>
 
-static void timeStamp(std::ofstream& stream, bool includeDate)
+static void timeStamp(std::ofstream& stream, const SYSTEMTIME& systemTime, bool includeDate)
 {
 	char buffer[256];
 
-	SYSTEMTIME systemTime;
-	GetLocalTime(&systemTime);
-
 	if (includeDate)
 	{
 		sprintf(buffer, "%02u.%02u.%u ", systemTime.wDay, systemTime.wMonth, systemTime.wYear);
@@ -17,7 +17,14 @@ static void timeStamp(std::ofstream& stream, bool includeDate)
 
 	sprintf(buffer, "%02u:%02u.%03u ", systemTime.wHour, systemTime.wMinute, systemTime.wMilliseconds);
 	stream << buffer;
+}
+
+static void timeStamp(std::ofstream& stream, bool includeDate)
+{
+	SYSTEMTIME systemTime;
+	GetLocalTime(&systemTime);
 
+	timeStamp(stream, systemTime, includeDate);
 	stream.flush();
 }
 
@@ -67,41 +74,165 @@ namespace RBX
 	static const char* warning     = " Warning: ";
 	static const char* error       = " Error:   ";
 
+	struct Log::Entry
+	{
+		Entry* next;
+		Severity severity;
+		unsigned long ticks;
+		std::string message;
+	};
+
 	void Log::writeEntry(Severity severity, const char* message)
 	{
-		//current()->timeStamp(false);
-		::timeStamp(currentStream(), false);
+		if (InterlockedIncrement(&queuedEntries) > maxQueuedEntries)
+		{
+			InterlockedDecrement(&queuedEntries);
+			InterlockedIncrement(&droppedEntries);
+			return;
+		}
+
+		Entry* entry = new Entry();
+		entry->severity = severity;
+		entry->ticks = GetTickCount();
+		entry->message = message;
 
-		switch (severity)
+		Entry* head;
+		do
 		{
-		case Warning:
-			currentStream() << warning;
-			break;
-		case Error:
-			currentStream() << error;
-			break;
-		default:
-			currentStream() << information;
-			break;
+			head = queueHead;
+			entry->next = head;
 		}
+		while (InterlockedCompareExchangePointer((PVOID volatile*)&queueHead, entry, head) != head);
 
-		currentStream() << message;
-		stream << '\n';
-		currentStream().flush();
+		// the writer drains the whole queue each time, so it only needs waking for the first entry
+		if (!head)
+			SetEvent(wakeEvent);
+	}
+
+	bool Log::writeQueued(bool& wroteError)
+	{
+		Entry* entries = (Entry*)InterlockedExchangePointer((PVOID volatile*)&queueHead, NULL);
+		if (!entries)
+			return false;
+
+		// the queue is newest first
+		Entry* ordered = NULL;
+		while (entries)
+		{
+			Entry* next = entries->next;
+			entries->next = ordered;
+			ordered = entries;
+			entries = next;
+		}
+
+		long count = 0;
+		while (ordered)
+		{
+			ULARGE_INTEGER time;
+			time.QuadPart = startTime + (unsigned __int64)(ordered->ticks - startTicks) * 10000;
+
+			FILETIME fileTime;
+			fileTime.dwLowDateTime = time.LowPart;
+			fileTime.dwHighDateTime = time.HighPart;
+
+			SYSTEMTIME systemTime;
+			FileTimeToSystemTime(&fileTime, &systemTime);
+			::timeStamp(stream, systemTime, false);
+
+			switch (ordered->severity)
+			{
+			case Warning:
+				stream << warning;
+				break;
+			case Error:
+				stream << error;
+				wroteError = true;
+				break;
+			default:
+				stream << information;
+				break;
+			}
+
+			stream << ordered->message << '\n';
+
+			Entry* next = ordered->next;
+			delete ordered;
+			ordered = next;
+			++count;
+		}
+
+		InterlockedExchangeAdd(&queuedEntries, -count);
+
+		long dropped = InterlockedExchange(&droppedEntries, 0);
+		if (dropped > 0)
+			stream << "          " << dropped << " log entries dropped\n";
+
+		return true;
+	}
+
+	void Log::writerProc()
+	{
+		DWORD lastFlush = GetTickCount();
+		bool unflushed = false;
+
+		while (!stopRequest)
+		{
+			DWORD waitResult = WaitForSingleObject(wakeEvent, flushIntervalMs);
+
+			bool wroteError = false;
+			if (writeQueued(wroteError))
+				unflushed = true;
+
+			// errors go to disk right away, in case they are the last thing written before a crash
+			if (unflushed && (wroteError || waitResult == WAIT_TIMEOUT || GetTickCount() - lastFlush >= flushIntervalMs))
+			{
+				stream.flush();
+				lastFlush = GetTickCount();
+				unflushed = false;
+			}
+		}
 	}
 
 	Log::Log(const char* logFile, const char* name)
 		: worstSeverity(Information),
 		  logFile(logFile),
-		  stream(logFile, 2, 64)
+		  stream(logFile, 2, 64),
+		  queueHead(NULL),
+		  queuedEntries(0),
+		  droppedEntries(0),
+		  stopRequest(false),
+		  wakeEvent(CreateEventA(NULL, FALSE, FALSE, NULL))
 	{
+		SYSTEMTIME systemTime;
+		GetLocalTime(&systemTime);
+		startTicks = GetTickCount();
+
+		FILETIME fileTime;
+		SystemTimeToFileTime(&systemTime, &fileTime);
+
+		ULARGE_INTEGER time;
+		time.LowPart = fileTime.dwLowDateTime;
+		time.HighPart = fileTime.dwHighDateTime;
+		startTime = time.QuadPart;
+
 		timeStamp(true);
 		stream << "Log \"" << name << "\"\n";
 		stream.flush();
+
+		writer.reset(new boost::thread(background_function(boost::bind(&Log::writerProc, this), "rbx_log")));
 	}
 
 	Log::~Log()
 	{
+		stopRequest = true;
+		SetEvent(wakeEvent);
+		writer->join();
+		writer.reset();
+
+		bool wroteError = false;
+		writeQueued(wroteError);
+		CloseHandle(wakeEvent);
+
 		timeStamp(true);
 		stream << "End Log\n";
 	}
@@ -0,0 +1,270 @@
+#include "util/Memory.h"
+#include "util/Debug.h"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/once.hpp>
+#include <algorithm>
+#include <malloc.h>
+#include <new>
+#include <windows.h>
+
+namespace RBX
+{
+	const char* const MemoryReport::Instances = "Instances";
+	const char* const MemoryReport::Names = "Names";
+	const char* const MemoryReport::Children = "Children";
+	const char* const MemoryReport::Listeners = "Listeners";
+	const char* const MemoryReport::Signals = "Signals";
+	const char* const MemoryReport::Primitives = "Primitives";
+	const char* const MemoryReport::Geometries = "Geometries";
+	const char* const MemoryReport::Bodies = "Bodies";
+	const char* const MemoryReport::SimBodies = "SimBodies";
+	const char* const MemoryReport::Surfaces = "Surfaces";
+	const char* const MemoryReport::SpatialNodes = "SpatialNodes";
+
+	MemoryReport::MemoryReport()
+		: totalBytes(0)
+	{
+	}
+
+	void MemoryReport::addObject(const Name& className, size_t bytes)
+	{
+		++classes[className.toString()].count;
+		add(Instances, className, bytes);
+	}
+
+	void MemoryReport::add(const char* subsystem, const Name& className, size_t bytes)
+	{
+		if (bytes == 0)
+			return;
+
+		Usage& subsystemUsage = subsystems[subsystem];
+		++subsystemUsage.count;
+		subsystemUsage.bytes += bytes;
+
+		classes[className.toString()].bytes += bytes;
+		totalBytes += bytes;
+	}
+
+	void MemoryReport::addShared(const void* block, const char* subsystem, const Name& className, size_t bytes)
+	{
+		if (sharedBlocks.insert(block).second)
+			add(subsystem, className, bytes);
+	}
+
+	// Object pools. Each size class has its own pool, with its own lock and a free list threaded
+	// through the free blocks. Pools take their chunks straight from VirtualAlloc, which hands out
+	// memory aligned to its 64KB allocation granularity; each chunk starts with the pool it belongs
+	// to, and a bitmap over the address space marks which 64KB regions are pool chunks. A block is
+	// returned to its pool without a global lock or a search, and blocks outside the pools (from
+	// malloc, when compaction is off or the object is big) carry no extra header.
+	// Chunks are never given back; a freed block is reused by the next object of the same size.
+	namespace
+	{
+		struct Pool;
+
+		union ChunkHeader
+		{
+			Pool* pool;
+			double align; // keeps the blocks behind the header 8 byte aligned
+		};
+
+		const size_t chunkShift = 16;
+		const size_t chunkBytes = (size_t)1 << chunkShift;
+		const size_t maxPooledSize = 4096; // bigger objects come straight from malloc
+		const size_t poolCount = maxPooledSize / 8;
+
+		// one bit per 64KB of a 32 bit address space. Bits are set before any block of their chunk
+		// is handed out and never cleared, so they can be read without a lock
+		const size_t regionCount = (size_t)1 << (32 - chunkShift);
+		volatile long pooledRegions[regionCount / 32];
+
+		size_t regionOf(const void* ptr)
+		{
+			return (size_t)ptr >> chunkShift;
+		}
+
+		bool isPooled(const void* ptr)
+		{
+			size_t region = regionOf(ptr);
+			return region < regionCount && (pooledRegions[region / 32] & (1L << (region % 32))) != 0;
+		}
+
+		void markPooled(const void* chunk)
+		{
+			size_t region = regionOf(chunk);
+			RBXASSERT(region < regionCount);
+
+			volatile long* word = &pooledRegions[region / 32];
+			long bit = 1L << (region % 32);
+
+			long old;
+			do
+			{
+				old = *word;
+			}
+			while (InterlockedCompareExchange(word, old | bit, old) != old);
+		}
+
+		Pool* poolOf(const void* ptr)
+		{
+			return ((const ChunkHeader*)((size_t)ptr & ~(chunkBytes - 1)))->pool;
+		}
+
+		struct Pool
+		{
+			boost::mutex mutex;
+			size_t objectSize;
+			void* freeList;
+			size_t reservedBytes;
+			size_t usedBytes;
+
+			Pool()
+				: objectSize(0),
+				  freeList(NULL),
+				  reservedBytes(0),
+				  usedBytes(0)
+			{
+			}
+
+			void* allocate()
+			{
+				boost::mutex::scoped_lock lock(mutex);
+
+				if (!freeList)
+				{
+					char* chunk = (char*)VirtualAlloc(NULL, chunkBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+					if (!chunk)
+						throw std::bad_alloc();
+
+					((ChunkHeader*)chunk)->pool = this;
+					markPooled(chunk);
+					reservedBytes += chunkBytes;
+
+					size_t count = (chunkBytes - sizeof(ChunkHeader)) / objectSize;
+					for (size_t i = count; i-- > 0; )
+					{
+						void* block = chunk + sizeof(ChunkHeader) + i * objectSize;
+						*(void**)block = freeList;
+						freeList = block;
+					}
+				}
+
+				void* block = freeList;
+				freeList = *(void**)block;
+				usedBytes += objectSize;
+				return block;
+			}
+
+			void release(void* block)
+			{
+				boost::mutex::scoped_lock lock(mutex);
+
+				*(void**)block = freeList;
+				freeList = block;
+				usedBytes -= objectSize;
+			}
+		};
+
+		volatile bool compaction = false;
+
+		Pool* pools = NULL;
+		boost::once_flag poolsFlag = BOOST_ONCE_INIT;
+
+		void initPools()
+		{
+			pools = new Pool[poolCount];
+			for (size_t i = 0; i < poolCount; ++i)
+				pools[i].objectSize = (i + 1) * 8;
+		}
+
+		Pool* getPools()
+		{
+			boost::call_once(initPools, poolsFlag);
+			return pools;
+		}
+
+		size_t poolSize(size_t size)
+		{
+			if (size < sizeof(void*))
+				size = sizeof(void*);
+
+			return (size + 7) & ~(size_t)7;
+		}
+	}
+
+	void Memory::setCompaction(bool value)
+	{
+		compaction = value;
+	}
+
+	bool Memory::getCompaction()
+	{
+		return compaction;
+	}
+
+	void* Memory::allocateObject(size_t size)
+	{
+		if (compaction && size <= maxPooledSize)
+			return getPools()[poolSize(size) / 8 - 1].allocate();
+
+		void* block = malloc(size);
+		if (!block)
+			throw std::bad_alloc();
+
+		return block;
+	}
+
+	void Memory::freeObject(void* ptr, size_t size)
+	{
+		if (!ptr)
+			return;
+
+		if (isPooled(ptr))
+		{
+			Pool* pool = poolOf(ptr);
+			RBXASSERT(pool->objectSize == poolSize(size));
+			pool->release(ptr);
+		}
+		else
+		{
+			free(ptr);
+		}
+	}
+
+	size_t Memory::blockSize(const void* ptr)
+	{
+		if (!ptr)
+			return 0;
+
+		if (isPooled(ptr))
+			return poolOf(ptr)->objectSize;
+
+		return _msize(const_cast<void*>(ptr));
+	}
+
+	size_t Memory::getPoolReservedBytes()
+	{
+		Pool* p = getPools();
+
+		size_t bytes = 0;
+		for (size_t i = 0; i < poolCount; ++i)
+		{
+			boost::mutex::scoped_lock lock(p[i].mutex);
+			bytes += p[i].reservedBytes;
+		}
+		return bytes;
+	}
+
+	size_t Memory::getPoolUsedBytes()
+	{
+		Pool* p = getPools();
+
+		size_t bytes = 0;
+		for (size_t i = 0; i < poolCount; ++i)
+		{
+			boost::mutex::scoped_lock lock(p[i].mutex);
+			bytes += p[i].usedBytes;
+		}
+		return bytes;
+	}
+}
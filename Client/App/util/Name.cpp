@@ -1,6 +1,7 @@
 #include "util/Name.h"
 #include "util/Debug.h"
 #include <boost/thread/once.hpp>
+#include <windows.h>
 
 // intentionally outside of the RBX namespace
 boost::once_flag flag = BOOST_ONCE_INIT;
@@ -18,6 +19,41 @@ void initMoo()
 
 namespace RBX
 {
+	// Open-addressed table of interned names.
+	// Readers never lock: slots and the table pointer are only ever written with interlocked
+	// exchanges after the Name they publish is fully constructed. Writers are serialized by mutex().
+	// A full table is replaced by a larger copy; old tables are never freed, so a reader still
+	// probing one stays safe (Names are immortal anyway).
+	struct Name::Table
+	{
+		size_t mask;
+		size_t count;
+		Name* volatile* slots;
+
+		Table(size_t capacity)
+			: mask(capacity - 1),
+			  count(0),
+			  slots(new Name* volatile[capacity])
+		{
+			for (size_t i = 0; i < capacity; ++i)
+				slots[i] = NULL;
+		}
+	};
+
+	Name::Table* volatile Name::table = NULL;
+
+	static size_t hashString(const char* s, size_t length)
+	{
+		// FNV-1a
+		size_t h = 2166136261u;
+		for (size_t i = 0; i < length; ++i)
+		{
+			h ^= (unsigned char)s[i];
+			h *= 16777619u;
+		}
+		return h;
+	}
+
 	// seems to be inlined
 	boost::mutex& Name::mutex()
 	{
@@ -31,17 +67,71 @@ namespace RBX
 		return d;
 	}
 
-	Name::NamMap& Name::namMap()
+	const Name* Name::find(const char* sName, size_t length, size_t hash)
+	{
+		Table* t = table;
+		if (!t)
+			return NULL;
+
+		for (size_t i = hash & t->mask; ; i = (i + 1) & t->mask)
+		{
+			const Name* n = t->slots[i];
+			if (!n)
+				return NULL;
+
+			if (n->hash == hash && n->name.size() == length && memcmp(n->name.data(), sName, length) == 0)
+				return n;
+		}
+	}
+
+	void Name::insert(Name* name)
+	{
+		Table* t = table;
+
+		// keep the load factor at or below 0.5 so probes stay short
+		if (!t || (t->count + 1) * 2 > t->mask + 1)
+		{
+			Table* grown = new Table(t ? (t->mask + 1) * 2 : 1024);
+			if (t)
+			{
+				for (size_t i = 0; i <= t->mask; ++i)
+				{
+					Name* n = t->slots[i];
+					if (n)
+					{
+						size_t j = n->hash & grown->mask;
+						while (grown->slots[j])
+							j = (j + 1) & grown->mask;
+						grown->slots[j] = n;
+						++grown->count;
+					}
+				}
+			}
+
+			InterlockedExchangePointer((PVOID volatile*)&table, grown);
+			t = grown;
+		}
+
+		size_t i = name->hash & t->mask;
+		while (t->slots[i])
+			i = (i + 1) & t->mask;
+
+		++t->count;
+		InterlockedExchangePointer((PVOID volatile*)&t->slots[i], name);
+	}
+
+	static const Name* nullName = NULL;
+	static boost::once_flag nullNameFlag = BOOST_ONCE_INIT;
+
+	static void initNullName()
 	{
-		static NamMap n;
-		return n;
+		nullName = &Name::declare("", 0);
 	}
 
 	const Name& Name::getNullName()
 	{
-		boost::mutex::scoped_lock scoped_lock(mutex());
-		static const Name& nullName = declare("", 0);
-		return nullName;
+		boost::call_once(initNullName, nullNameFlag);
+		return *nullName;
 	}
 
 	const Name& Name::declare(const char* sName, int dictionaryIndex)
@@ -52,41 +142,58 @@ namespace RBX
 			return getNullName();
 		}
 
+		size_t length = strlen(sName);
+		size_t hash = hashString(sName, length);
+
+		if (dictionaryIndex == -1)
+		{
+			const Name* found = find(sName, length, hash);
+			if (found)
+				return *found;
+		}
+
 		boost::mutex::scoped_lock scoped_lock(mutex());
 
-		NamMap::iterator iter = namMap().find(sName);
-		if (iter != namMap().end())
+		Name* name = const_cast<Name*>(find(sName, length, hash));
+		if (name)
 		{
 			if (dictionaryIndex != -1)
 			{
-				RBXASSERT(iter->second->dictionaryIndex == dictionaryIndex || iter->second->dictionaryIndex == -1);
-				dictionary()[dictionaryIndex] = iter->second;
+				RBXASSERT(name->dictionaryIndex == dictionaryIndex || name->dictionaryIndex == -1);
+				dictionary()[dictionaryIndex] = name;
 			}
-			return *iter->second;
+			return *name;
 		}
 		else
 		{
-			Name* name = new Name(sName, dictionaryIndex);
-			namMap()[sName] = name;
-			dictionary()[dictionaryIndex] = name;
+			name = new Name(sName, dictionaryIndex, hash);
+			insert(name);
+			if (dictionaryIndex != -1)
+				dictionary()[dictionaryIndex] = name;
 			return *name;
 		}
 	}
 
+	const Name& Name::lookup(int dictionaryIndex)
+	{
+		const Name* found = NULL;
+		{
+			boost::mutex::scoped_lock scoped_lock(mutex());
+
+			std::map<int, Name*>::iterator iter = dictionary().find(dictionaryIndex);
+			if (iter != dictionary().end())
+				found = iter->second;
+		}
+
+		return found ? *found : getNullName();
+	}
+
 	const Name& Name::lookup(const std::string& sName)
 	{
 		RBXASSERT(sName.size() < 50);
-		boost::mutex::scoped_lock scoped_lock(mutex());
 
-		NamMap::iterator iter = namMap().find(sName);
-		if (iter != namMap().end())
-		{
-			return *iter->second;
-		}
-		else
-		{
-			return getNullName();
-		}
+		const Name* found = find(sName.data(), sName.size(), hashString(sName.data(), sName.size()));
+		return found ? *found : getNullName();
 	}
 
 	const Name& Name::lookup(const char* sName)
@@ -96,6 +203,10 @@ namespace RBX
 			return getNullName();
 		}
 
-		return lookup(std::string(sName));
+		size_t length = strlen(sName);
+		RBXASSERT(length < 50);
+
+		const Name* found = find(sName, length, hashString(sName, length));
+		return found ? *found : getNullName();
 	}
 }
@@ -0,0 +1,125 @@
+#include "util/SharedString.h"
+#include "util/Memory.h"
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/once.hpp>
+#include <map>
+#include <windows.h>
+
+namespace RBX
+{
+	namespace
+	{
+		struct StringLess
+		{
+			bool operator()(const std::string* a, const std::string* b) const
+			{
+				return *a < *b;
+			}
+		};
+
+		// Interned strings, keyed by the text they hold. Interned reps are only released under the
+		// mutex so a lookup can never resurrect one that is being deleted.
+		struct InternTable
+		{
+			boost::mutex mutex;
+			std::map<const std::string*, void*, StringLess> strings;
+		};
+
+		InternTable* internTable = NULL;
+		const std::string* emptyString = NULL;
+		boost::once_flag initFlag = BOOST_ONCE_INIT;
+
+		void init()
+		{
+			internTable = new InternTable();
+			emptyString = new std::string();
+		}
+	}
+
+	const std::string& SharedString::empty()
+	{
+		boost::call_once(init, initFlag);
+		return *emptyString;
+	}
+
+	SharedString::Rep* SharedString::make(const std::string& value)
+	{
+		if (value.empty())
+			return NULL;
+
+		boost::call_once(init, initFlag);
+		boost::mutex::scoped_lock lock(internTable->mutex);
+
+		std::map<const std::string*, void*, StringLess>::iterator iter = internTable->strings.find(&value);
+		if (iter != internTable->strings.end())
+		{
+			Rep* rep = static_cast<Rep*>(iter->second);
+			InterlockedIncrement(&rep->refs);
+			return rep;
+		}
+
+		Rep* rep = new Rep(value);
+		internTable->strings.insert(std::make_pair(&rep->value, static_cast<void*>(rep)));
+		return rep;
+	}
+
+	void SharedString::addRef(Rep* rep)
+	{
+		if (rep)
+			InterlockedIncrement(&rep->refs);
+	}
+
+	void SharedString::release(Rep* rep)
+	{
+		if (!rep)
+			return;
+
+		boost::mutex::scoped_lock lock(internTable->mutex);
+		if (InterlockedDecrement(&rep->refs) == 0)
+		{
+			internTable->strings.erase(&rep->value);
+			delete rep;
+		}
+	}
+
+	SharedString::SharedString(const std::string& value)
+		: rep(make(value))
+	{
+	}
+
+	SharedString::SharedString(const char* value)
+		: rep(value ? make(value) : NULL)
+	{
+	}
+
+	SharedString::SharedString(const SharedString& other)
+		: rep(other.rep)
+	{
+		addRef(rep);
+	}
+
+	SharedString::~SharedString()
+	{
+		release(rep);
+	}
+
+	SharedString& SharedString::operator=(const SharedString& other)
+	{
+		Rep* old = rep;
+		rep = other.rep;
+		addRef(rep);
+		release(old);
+		return *this;
+	}
+
+	size_t SharedString::getHeapBytes() const
+	{
+		if (!rep)
+			return 0;
+
+		// short strings live inside std::string itself, in a buffer of _BUF_SIZE (16) chars that
+		// holds a capacity of 15
+		size_t capacity = rep->value.capacity();
+		return Memory::blockSize(rep) + (capacity >= 16 ? capacity + 1 : 0);
+	}
+}
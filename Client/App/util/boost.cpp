@@ -5,6 +5,7 @@
 #include <windows.h>
 #include <boost/thread/tss.hpp>
 #include <boost/thread/once.hpp>
+#include <algorithm>
 
 namespace RBX
 {
@@ -130,18 +131,161 @@ namespace RBX
 	void worker_thread::wake()
 	{
 		boost::mutex::scoped_lock scoped_lock(_data->sync);
+		_data->wakeRequest = true;
 		_data->wakeCondition.notify_all();
 	}
 
 	void worker_thread::threadProc(boost::shared_ptr<data> data, const boost::function0<enum work_result>& work_function)
 	{
-		while (!data->endRequest)
+		while (true)
 		{
-			if (work_function() != more)
 			{
 				boost::mutex::scoped_lock scoped_lock(data->sync);
-				data->wakeCondition.wait(scoped_lock);	
+				if (data->endRequest)
+					break;
+
+				// cleared before the work, so a wake that arrives during it is still seen below
+				data->wakeRequest = false;
 			}
+
+			if (work_function() == more)
+				continue;
+
+			boost::mutex::scoped_lock scoped_lock(data->sync);
+			while (!data->wakeRequest && !data->endRequest)
+				data->wakeCondition.wait(scoped_lock);
+		}
+	}
+
+	thread_pool::thread_pool(int threadCount, const char* name)
+		: job(NULL),
+		  jobCount(0),
+		  nextIndex(0),
+		  pending(0),
+		  endRequest(false),
+		  threadCount(threadCount)
+	{
+		for (int i = 0; i < threadCount; ++i)
+			threads.create_thread(background_function(boost::bind(&thread_pool::threadProc, this), name));
+	}
+
+	thread_pool::~thread_pool()
+	{
+		{
+			boost::mutex::scoped_lock scoped_lock(sync);
+			endRequest = true;
+			wakeCondition.notify_all();
+		}
+
+		threads.join_all();
+	}
+
+	void thread_pool::parallel_for(size_t count, const boost::function1<void, size_t>& func)
+	{
+		if (count == 0)
+			return;
+
+		boost::mutex::scoped_lock runLock(runSync);
+
+		{
+			boost::mutex::scoped_lock scoped_lock(sync);
+			job = &func;
+			jobCount = count;
+			nextIndex = 0;
+			pending = count;
+			error.clear();
+			wakeCondition.notify_all();
 		}
+
+		work();
+
+		boost::mutex::scoped_lock scoped_lock(sync);
+		while (pending > 0)
+			doneCondition.wait(scoped_lock);
+
+		job = NULL;
+
+		if (!error.empty())
+			throw std::runtime_error(error);
+	}
+
+	void thread_pool::work()
+	{
+		while (true)
+		{
+			const boost::function1<void, size_t>* func;
+			size_t index;
+			{
+				boost::mutex::scoped_lock scoped_lock(sync);
+				if (!job || nextIndex >= jobCount)
+					return;
+
+				func = job;
+				index = nextIndex++;
+			}
+
+			// nothing may escape: every index has to be counted off, or parallel_for waits forever
+			// (or, on the calling thread, returns while the workers still use func)
+			bool failed = false;
+			std::string what;
+			try
+			{
+				try
+				{
+					(*func)(index);
+				}
+				catch (std::exception& ex)
+				{
+					failed = true;
+					what = ex.what();
+				}
+			}
+			catch (...)
+			{
+				failed = true;
+			}
+
+			boost::mutex::scoped_lock scoped_lock(sync);
+			if (failed && error.empty())
+				error = what.empty() ? "unknown exception in parallel_for" : what;
+
+			if (--pending == 0)
+				doneCondition.notify_all();
+		}
+	}
+
+	void thread_pool::threadProc()
+	{
+		while (true)
+		{
+			{
+				boost::mutex::scoped_lock scoped_lock(sync);
+				while (!endRequest && (!job || nextIndex >= jobCount))
+					wakeCondition.wait(scoped_lock);
+
+				if (endRequest)
+					return;
+			}
+
+			work();
+		}
+	}
+
+	static thread_pool* sharedPool = NULL;
+	static boost::once_flag sharedPoolFlag = BOOST_ONCE_INIT;
+
+	static void initSharedPool()
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+
+		static thread_pool pool(std::max<int>(1, (int)info.dwNumberOfProcessors - 1), "rbx_threadpool");
+		sharedPool = &pool;
+	}
+
+	thread_pool& thread_pool::singleton()
+	{
+		boost::call_once(initSharedPool, sharedPoolFlag);
+		return *sharedPool;
 	}
 }
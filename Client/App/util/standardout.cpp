@@ -6,19 +6,24 @@ namespace RBX
 {
 	void StandardOut::print(MessageType type, const char* format, ...)
 	{
+		// formatting is the expensive part when nothing is listening, so only do it for a reader
+		Log* log = type != MESSAGE_OUTPUT ? Log::current() : NULL;
+		if (!log && !Notifier<StandardOut, StandardOutMessage>::hasListeners())
+			return;
+
 		va_list argsList;
 		va_start(argsList, format);
 		std::string message = G3D::vformat(format, argsList);
 		va_end(argsList);
 
-		if (Log::current())
+		if (log)
 		{
 			if (type == MESSAGE_ERROR)
-				Log::current()->writeEntry(Log::Error, message.c_str());
+				log->writeEntry(Log::Error, message.c_str());
 			else if (type == MESSAGE_WARNING)
-				Log::current()->writeEntry(Log::Warning, message.c_str());
+				log->writeEntry(Log::Warning, message.c_str());
 			else if (type == MESSAGE_INFO)
-				Log::current()->writeEntry(Log::Information, message.c_str());
+				log->writeEntry(Log::Information, message.c_str());
 		}
 
 		if (Notifier<StandardOut, StandardOutMessage>::hasListeners())
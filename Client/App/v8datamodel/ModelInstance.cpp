@@ -29,6 +29,10 @@ namespace RBX
 		: Base("Model"),
 		  modelInPrimary(),
 		  primaryPart(NULL),
+		  noPrimaryPartCandidate(false),
+		  childExtents(),
+		  childExtentsFrame(),
+		  PrimitiveExtents(this, &ModelInstance::computePrimitiveExtents),
 		  FlagHeight(this, &ModelInstance::computeFlagHeight),
 		  LocalGridExtents(this, &ModelInstance::computeLocalGridExtents),
 		  WorldGridExtents(this, &ModelInstance::computeWorldGridExtents)
@@ -49,6 +53,7 @@ namespace RBX
 
 	void ModelInstance::dirtyAll() const
 	{
+		PrimitiveExtents.setDirty();
 		LocalGridExtents.setDirty();
 		WorldGridExtents.setDirty();
 		FlagHeight.setDirty();
@@ -65,10 +70,41 @@ namespace RBX
 		PVInstance::onExtentsChanged();
 	}
 
+	void ModelInstance::onChildExtentsChanged(const PVInstance* child) const
+	{
+		std::map<const Instance*, ChildExtents>::iterator iter = childExtents.find(child);
+		if (iter != childExtents.end())
+			iter->second.dirty = true;
+
+		onExtentsChanged();
+	}
+
+	void ModelInstance::dirtyChildExtents(const Instance* descendent) const
+	{
+		const Instance* child = descendent;
+		while (child && child->getParent() != this)
+			child = child->getParent();
+
+		if (child)
+		{
+			std::map<const Instance*, ChildExtents>::iterator iter = childExtents.find(child);
+			if (iter != childExtents.end())
+			{
+				if (child == descendent)
+					childExtents.erase(iter); // a child coming or going
+				else
+					iter->second.dirty = true;
+			}
+		}
+
+		dirtyAll();
+	}
+
 	void ModelInstance::onDescendentAdded(Instance* instance)
 	{
 		PVInstance::onDescendentAdded(instance);
-		dirtyAll();
+		dirtyChildExtents(instance);
+		noPrimaryPartCandidate = false;
 
 		if (instance == candidatePrimaryPart.get())
 		{
@@ -92,7 +128,7 @@ namespace RBX
 			candidatePrimaryPart.reset();
 		}
 
-		dirtyAll();
+		dirtyChildExtents(instance.get());
 		shouldRenderSetDirty();
 		PVInstance::onDescendentRemoving(instance);
 	}
@@ -137,6 +173,8 @@ namespace RBX
 
 	void ModelInstance::setPrimaryPart(PartInstance* set)
 	{
+		noPrimaryPartCandidate = false;
+
 		if (!set || this == primaryPart->getParent() || (primaryPart->getParent() && primaryPart->getParent()->isDescendentOf(this)))
 		{
 			candidatePrimaryPart.reset();
@@ -217,6 +255,10 @@ namespace RBX
 			RBXASSERT(this == primaryPart->getParent() || (primaryPart->getParent() && primaryPart->getParent()->isDescendentOf(this)));
 			return primaryPart;
 		}
+		else if (noPrimaryPartCandidate)
+		{
+			return NULL;
+		}
 		else
 		{
 			float biggest = -1.0f;
@@ -244,31 +286,88 @@ namespace RBX
 			}
 
 			updatePrimaryPart(biggestPart);
+			noPrimaryPartCandidate = biggestPart == NULL;
 			return biggestPart;
 		}
 	}
 
-	Extents ModelInstance::computeLocalGridExtents() const
+	static bool isEmpty(const Extents& extents)
 	{
-		std::vector<const Primitive*> primitives;
-		DragUtilities::getPrimitivesConst(this, primitives);
+		return extents.min().x > extents.max().x;
+	}
+
+	Extents ModelInstance::computeChildExtents(const Instance* child, const G3D::CoordinateFrame& location)
+	{
+		// a model with the same axes as ours hands over its own cached box, which stays exact
+		const ModelInstance* model = fastDynamicCast<const ModelInstance>(child);
+		if (model)
+		{
+			G3D::CoordinateFrame modelLocation = model->getLocation();
+			if (modelLocation.rotation == location.rotation)
+			{
+				Extents modelExtents = model->PrimitiveExtents;
+				return isEmpty(modelExtents) ? modelExtents : modelExtents.express(modelLocation, location);
+			}
+		}
 
 		Extents answer = Extents::negativeInfiniteExtents();
 
-		for (size_t i = 0; i < primitives.size(); i++)
+		const PartInstance* part = fastDynamicCast<const PartInstance>(child);
+		if (part)
 		{
-			const Primitive* primitive = primitives[i];
+			const Primitive* primitive = part->getPrimitive();
 			Extents localExtents = primitive->getExtentsLocal();
-			Extents childExtentsInMe = localExtents.express(primitive->getCoordinateFrame(), getLocation());
-			answer.unionWith(childExtentsInMe);
+			answer.unionWith(localExtents.express(primitive->getCoordinateFrame(), location));
 		}
 
-		if (primitives.empty())
-			answer = Extents::zero();
+		for (size_t i = 0; i < child->numChildren(); ++i)
+		{
+			Extents childExtents = computeChildExtents(child->getChild(i), location);
+			if (!isEmpty(childExtents))
+				answer.unionWith(childExtents);
+		}
 
 		return answer;
 	}
 
+	Extents ModelInstance::computePrimitiveExtents() const
+	{
+		G3D::CoordinateFrame location = getLocation();
+		if (location != childExtentsFrame)
+		{
+			// the primary part moved; every entry is expressed in the old frame
+			childExtentsFrame = location;
+			for (std::map<const Instance*, ChildExtents>::iterator iter = childExtents.begin(); iter != childExtents.end(); ++iter)
+				iter->second.dirty = true;
+		}
+
+		Extents answer = Extents::negativeInfiniteExtents();
+
+		for (size_t i = 0; i < numChildren(); ++i)
+		{
+			const Instance* child = getChild(i);
+			ChildExtents& entry = childExtents[child];
+
+			// parts under a non-PV child don't report their moves, so those are always refitted
+			if (entry.dirty || !fastDynamicCast<const PVInstance>(child))
+			{
+				entry.extents = computeChildExtents(child, location);
+				entry.dirty = false;
+			}
+
+			if (!isEmpty(entry.extents))
+				answer.unionWith(entry.extents);
+		}
+
+		return answer;
+	}
+
+	Extents ModelInstance::computeLocalGridExtents() const
+	{
+		Extents answer = PrimitiveExtents;
+		return isEmpty(answer) ? Extents::zero() : answer;
+	}
+
 	Extents ModelInstance::computeWorldGridExtents() const
 	{
 		return LocalGridExtents.getValue().express(getLocation(), G3D::CoordinateFrame());
@@ -278,19 +377,16 @@ namespace RBX
 	{
 		RBXASSERT(legacyOffset);
 
-		if (&(*getChildren()))
+		int count = (int)getChildren().size();
+		if (count > 0)
 		{
-			int count = (int)getChildren()->size();
-			if (count > 0)
+			G3D::CoordinateFrame myState = parentState * (*legacyOffset);
+			for (int i = 0; i < count; ++i)
 			{
-				G3D::CoordinateFrame myState = parentState * (*legacyOffset);
-				for (int i = 0; i < count; ++i)
-				{
-					Instance* child = getChild(i);
-					PVInstance* pvChild = fastDynamicCast<PVInstance>(child);
-					if (pvChild)
-						pvChild->legacyTraverseState(myState);
-				}
+				Instance* child = getChild(i);
+				PVInstance* pvChild = fastDynamicCast<PVInstance>(child);
+				if (pvChild)
+					pvChild->legacyTraverseState(myState);
 			}
 		}
 	}
@@ -348,7 +444,7 @@ namespace RBX
 
 	void ModelInstance::onCameraNear(float distance)
 	{
-		for (size_t i = 0; i < getChildren()->size(); ++i)
+		for (size_t i = 0; i < getChildren().size(); ++i)
 		{
 			Instance* child = getChild(i);
 			ICameraSubject* cameraSubject = fastDynamicCast<ICameraSubject>(child);
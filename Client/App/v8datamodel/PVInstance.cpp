@@ -204,7 +204,12 @@ namespace RBX
 	{
 		PVInstance* pvParent = fastDynamicCast<PVInstance>(getParent());
 		if (pvParent)
-			pvParent->onExtentsChanged();
+			pvParent->onChildExtentsChanged(this);
+	}
+
+	void PVInstance::onChildExtentsChanged(const PVInstance* child) const
+	{
+		onExtentsChanged();
 	}
 
 	void PVInstance::setControllerType(Controller::ControllerType _control)
@@ -265,6 +265,15 @@ namespace RBX
 		event_Touched.fire(this, other);
 	}
 
+	void PartInstance::reportMemory(MemoryReport& report) const
+	{
+		PVInstance::reportMemory(report);
+
+		report.add(MemoryReport::Listeners, getClassName(), Notifier<PartInstance, CanAggregateChanged>::getListenerBytes());
+		if (primitive)
+			primitive->reportMemory(report, getClassName());
+	}
+
 	void PartInstance::setCoordinateFrame(const G3D::CoordinateFrame& value)
 	{
 		if (value != getCoordinateFrame())
@@ -0,0 +1,154 @@
+#include "v8datamodel/TouchEventDispatcher.h"
+#include "v8datamodel/PartInstance.h"
+#include "v8world/World.h"
+#include "util/Debug.h"
+#include <G3D/System.h>
+#include <algorithm>
+
+namespace RBX
+{
+	namespace
+	{
+		struct Delivery
+		{
+			Primitive* touch;
+			boost::shared_ptr<PartInstance> part;
+			boost::shared_ptr<PartInstance> other;
+			Guid::Data partId;
+			Guid::Data otherId;
+
+			// by Guid, so the order doesn't depend on where the parts happen to be allocated
+			bool operator<(const Delivery& that) const
+			{
+				if (partId < that.partId)
+					return true;
+				if (that.partId < partId)
+					return false;
+
+				return otherId < that.otherId;
+			}
+		};
+	}
+
+	bool TouchEventDispatcher::TouchPair::operator<(const TouchPair& other) const
+	{
+		if (touch != other.touch)
+			return touch < other.touch;
+
+		return this->other < other.other;
+	}
+
+	bool TouchEventDispatcher::TouchPair::operator==(const TouchPair& other) const
+	{
+		return touch == other.touch && this->other == other.other;
+	}
+
+	TouchEventDispatcher::TouchEventDispatcher()
+		: maxTouchesPerSecond(0)
+	{
+	}
+
+	void TouchEventDispatcher::setMaxTouchesPerSecond(int value)
+	{
+		RBXASSERT(value >= 0);
+
+		maxTouchesPerSecond = value;
+		if (value == 0)
+			rateWindows.clear();
+	}
+
+	bool TouchEventDispatcher::withinRateLimit(const Primitive* touch, double now)
+	{
+		if (maxTouchesPerSecond == 0)
+			return true;
+
+		std::map<const Primitive*, RateWindow>::iterator iter = rateWindows.find(touch);
+		if (iter == rateWindows.end())
+		{
+			RateWindow window = { now, 0 };
+			iter = rateWindows.insert(std::make_pair(touch, window)).first;
+		}
+		else if (now - iter->second.start >= 1.0)
+		{
+			iter->second.start = now;
+			iter->second.count = 0;
+		}
+
+		return ++iter->second.count <= maxTouchesPerSecond;
+	}
+
+	void TouchEventDispatcher::dispatch(const World& world)
+	{
+		const G3D::Array<Primitive*>& touch = world.getTouch();
+		const G3D::Array<Primitive*>& touchOther = world.getTouchOther();
+		RBXASSERT(touch.size() == touchOther.size());
+
+		lastStep = Metrics();
+		lastStep.reported = touch.size();
+
+		pairs.resize(touch.size());
+		for (int i = 0; i < touch.size(); ++i)
+		{
+			pairs[i].touch = touch[i];
+			pairs[i].other = touchOther[i];
+		}
+
+		std::sort(pairs.begin(), pairs.end());
+		pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+		lastStep.duplicates = lastStep.reported - (int)pairs.size();
+
+		double now = G3D::System::getTick();
+
+		// windows of parts that haven't touched anything for a while are dropped, so removed
+		// primitives don't pile up here
+		for (std::map<const Primitive*, RateWindow>::iterator iter = rateWindows.begin(); iter != rateWindows.end(); )
+		{
+			if (now - iter->second.start >= 1.0)
+				rateWindows.erase(iter++);
+			else
+				++iter;
+		}
+
+		std::vector<Delivery> deliveries;
+		deliveries.reserve(pairs.size());
+
+		for (size_t i = 0; i < pairs.size(); ++i)
+		{
+			PartInstance* part = PartInstance::fromPrimitive(pairs[i].touch);
+			PartInstance* other = PartInstance::fromPrimitive(pairs[i].other);
+			if (!part || !other)
+				continue;
+
+			Delivery delivery;
+			delivery.touch = pairs[i].touch;
+			delivery.part = shared_from(part);
+			delivery.other = shared_from(other);
+			part->getGuid().extract(delivery.partId);
+			other->getGuid().extract(delivery.otherId);
+			deliveries.push_back(delivery);
+		}
+
+		// the rate limit goes in delivery order, so which pairs it drops is stable too
+		std::sort(deliveries.begin(), deliveries.end());
+
+		size_t kept = 0;
+		for (size_t i = 0; i < deliveries.size(); ++i)
+		{
+			if (withinRateLimit(deliveries[i].touch, now))
+				deliveries[kept++] = deliveries[i];
+			else
+				++lastStep.rateLimited;
+		}
+		deliveries.resize(kept);
+
+		for (size_t i = 0; i < deliveries.size(); ++i)
+			deliveries[i].part->onTouchThisStep(deliveries[i].other);
+
+		lastStep.delivered = (int)deliveries.size();
+
+		total.reported += lastStep.reported;
+		total.duplicates += lastStep.duplicates;
+		total.rateLimited += lastStep.rateLimited;
+		total.delivered += lastStep.delivered;
+	}
+}
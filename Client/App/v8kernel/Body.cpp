@@ -34,6 +34,15 @@ Body::~Body()
 	RBXASSERT(root == this);
 }
 
+void Body::reportMemory(MemoryReport& report, const Name& owner) const
+{
+	report.add(MemoryReport::Bodies, owner, Memory::blockSize(this));
+	if (cofm)
+		report.add(MemoryReport::Bodies, owner, Memory::blockSize(cofm));
+	if (simBody)
+		report.add(MemoryReport::SimBodies, owner, Memory::blockSize(simBody));
+}
+
 void Body::updatePV() const
 {
 	RBXASSERT((parent != NULL) || (getRootConst() == this));
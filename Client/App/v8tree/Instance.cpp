@@ -1,6 +1,12 @@
 #include "v8tree/Instance.h"
 #include "reflection/function.h"
+#include <G3D/CoordinateFrame.h>
+#include <G3D/Color3.h>
+#include <G3D/Vector3.h>
+#include <boost/scoped_array.hpp>
+#include <boost/thread/mutex.hpp>
 #include <algorithm>
+#include <map>
 
 namespace RBX
 {
@@ -26,10 +32,27 @@ namespace RBX
 	Reflection::SignalDesc<Instance, void(boost::shared_ptr<Instance>)> Instance::event_ancestryChanged("AncestryChanged", "child"); // L31
 	Reflection::SignalDesc<Instance, void(const Reflection::PropertyDescriptor*)> Instance::event_propertyChanged("Changed", "property"); // L32 
 
+	// Position of the first child with each name.
+	// Appended children are folded in lazily; a removal or a rename throws the index away.
+	struct Instance::NameIndex
+	{
+		std::map<std::string, size_t> firstChild;
+		size_t indexedCount;
+		unsigned int removalCount;
+
+		// below this many children a linear scan is just as fast
+		static const size_t threshold = 16;
+	};
+
+	// Lookups are const and may come from several threads, but they build the index as they go.
+	// Held while an index is built, used or thrown away
+	static boost::mutex nameIndexMutex;
+
 	Instance::Instance(const char* name)
 		: assoc(),
 		  parent(NULL),
 		  children(),
+		  nameIndex(),
 		  name(name),
 		  archivable(true),
 		  guid()
@@ -40,6 +63,7 @@ namespace RBX
 		: assoc(),
 		  parent(NULL),
 		  children(),
+		  nameIndex(),
 		  name("Instance"),
 		  archivable(true),
 		  guid()
@@ -88,10 +112,7 @@ namespace RBX
 
 	size_t Instance::numChildren() const
 	{
-		if (&(*children))
-			return children->size();
-		else
-			return 0;
+		return children.size();
 	}
 
 	Instance* Instance::getRootAncestor()
@@ -106,9 +127,15 @@ namespace RBX
 
 	void Instance::setName(const std::string& value)
 	{
-		if (name != value)
+		if (name.str() != value)
 		{
-			name = value;
+			if (parent)
+			{
+				boost::mutex::scoped_lock lock(nameIndexMutex);
+				parent->nameIndex.reset();
+			}
+
+			name = SharedString(value);
 			raisePropertyChanged(desc_Name);
 		}
 	}
@@ -128,12 +155,53 @@ namespace RBX
 			p->onChildChanged(this, event);
 	}
 
+	void Instance::reportMemory(MemoryReport& report) const
+	{
+		const Name& className = getClassName();
+
+		report.addObject(className, Memory::blockSize(dynamic_cast<const void*>(this)));
+		report.addShared(name.getBlock(), MemoryReport::Names, className, name.getHeapBytes());
+
+		size_t childBytes = children.capacity() * sizeof(boost::shared_ptr<Instance>);
+		{
+			boost::mutex::scoped_lock lock(nameIndexMutex);
+			if (nameIndex.get())
+				childBytes += Memory::blockSize(nameIndex.get()) + nameIndex->firstChild.size() * (sizeof(std::pair<const std::string, size_t>) + 4 * sizeof(void*));
+		}
+		report.add(MemoryReport::Children, className, childBytes);
+
+		report.add(MemoryReport::Listeners, className,
+			Notifier<Instance, ChildAdded>::getListenerBytes() +
+			Notifier<Instance, ChildRemoved>::getListenerBytes() +
+			Notifier<Instance, DescendentAdded>::getListenerBytes() +
+			Notifier<Instance, DescendentRemoving>::getListenerBytes() +
+			Notifier<Instance, AncestorChanged>::getListenerBytes() +
+			Notifier<Instance, PropertyChanged>::getListenerBytes());
+
+		report.add(MemoryReport::Signals, className, getSignalBytes());
+	}
+
+	void Instance::reportTreeMemory(const Instance* root, MemoryReport& report)
+	{
+		std::vector<const Instance*> stack(1, root);
+		while (!stack.empty())
+		{
+			const Instance* instance = stack.back();
+			stack.pop_back();
+
+			instance->reportMemory(report);
+			for (size_t i = 0; i < instance->children.size(); ++i)
+				stack.push_back(instance->children[i].get());
+		}
+	}
+
 	void Instance::onDescendentAdded(Instance* instance)
 	{
 		if (Notifier<Instance, DescendentAdded>::hasListeners())
 			Notifier<Instance, DescendentAdded>::raise(DescendentAdded(instance, instance->parent));
 
-		event_descendentAdded.fire(this, shared_from(instance));
+		if (!event_descendentAdded.empty(this))
+			event_descendentAdded.fire(this, shared_from(instance));
 	}
 
 	void Instance::onDescendentRemoving(const boost::shared_ptr<Instance>& instance)
@@ -171,22 +239,297 @@ namespace RBX
 
 	void Instance::onAddListener(Listener<Instance, ChildAdded>* listener) const
 	{
-		if (&(*children))
+		Children::Snapshot c = children.read();
+		for (Children::Snapshot::const_iterator iter = c.begin(); iter != c.end(); iter++)
 		{
-			boost::shared_ptr<const std::vector<boost::shared_ptr<Instance>>> c = children.read();
-			for (std::vector<boost::shared_ptr<Instance>>::const_iterator iter = c->begin(); iter != c->end(); iter++)
+			Notifier<Instance, ChildAdded>::raise(ChildAdded((*iter).get()), listener);
+		}
+	}
+
+	void Instance::removeAllChildren()
+	{
+		while (!children.empty())
+		{
+			children.back()->setParent(NULL);
+		}
+	}
+
+	boost::shared_ptr<const std::vector<boost::shared_ptr<Instance>>> Instance::getChildren2()
+	{
+		Children::Snapshot c = children.read();
+		return boost::shared_ptr<const std::vector<boost::shared_ptr<Instance>>>(new std::vector<boost::shared_ptr<Instance>>(c.begin(), c.end()));
+	}
+
+	void Instance::addChildren(const std::vector<boost::shared_ptr<Instance>>& instances)
+	{
+		children.reserve(children.size() + instances.size());
+
+		for (size_t i = 0; i < instances.size(); ++i)
+			instances[i]->setParent(this);
+	}
+
+	// Maps the instances being cloned to their copies. Sorted once, then searched, so that
+	// remapping Ref properties doesn't cost a tree lookup per value
+	class CloneMap
+	{
+	private:
+		typedef std::pair<const Reflection::DescribedBase*, Reflection::DescribedBase*> Entry;
+		std::vector<Entry> entries;
+
+		static bool less(const Entry& a, const Entry& b)
+		{
+			return a.first < b.first;
+		}
+
+	public:
+		CloneMap(const std::vector<Instance*>& sources, const std::vector<boost::shared_ptr<Instance>>& copies)
+		{
+			entries.reserve(sources.size());
+			for (size_t i = 0; i < sources.size(); ++i)
+				if (copies[i])
+					entries.push_back(Entry(sources[i], copies[i].get()));
+
+			std::sort(entries.begin(), entries.end(), &CloneMap::less);
+		}
+
+		// References to instances outside of the cloned set are kept as they are
+		Reflection::DescribedBase* remap(Reflection::DescribedBase* target) const
+		{
+			std::vector<Entry>::const_iterator iter = std::lower_bound(entries.begin(), entries.end(), Entry(target, NULL), &CloneMap::less);
+			return iter != entries.end() && iter->first == target ? iter->second : target;
+		}
+	};
+
+	template<typename T>
+	static bool copyTypedColumn(const Reflection::ClassDescriptor& classDescriptor, const Reflection::PropertyDescriptor& desc, const std::vector<const Reflection::DescribedBase*>& sources, const std::vector<Reflection::DescribedBase*>& targets)
+	{
+		if (&desc.type != &Reflection::Type::singleton<T>())
+			return false;
+
+		const Reflection::TypedPropertyDescriptor<T>& typed = static_cast<const Reflection::TypedPropertyDescriptor<T>&>(desc);
+		boost::scoped_array<T> values(new T[sources.size()]);
+		classDescriptor.getPropertyColumn(typed, &sources[0], sources.size(), values.get());
+		classDescriptor.setPropertyColumn(typed, &targets[0], targets.size(), values.get());
+		return true;
+	}
+
+	static void copyColumn(const Reflection::ClassDescriptor& classDescriptor, const Reflection::PropertyDescriptor& desc, const std::vector<const Reflection::DescribedBase*>& sources, const std::vector<Reflection::DescribedBase*>& targets)
+	{
+		if (const Reflection::EnumPropertyDescriptor* enumDesc = dynamic_cast<const Reflection::EnumPropertyDescriptor*>(&desc))
+		{
+			for (size_t i = 0; i < sources.size(); ++i)
+				enumDesc->setEnumValue(targets[i], enumDesc->getEnumValue(sources[i]));
+		}
+		else if (copyTypedColumn<bool>(classDescriptor, desc, sources, targets)
+			|| copyTypedColumn<int>(classDescriptor, desc, sources, targets)
+			|| copyTypedColumn<float>(classDescriptor, desc, sources, targets)
+			|| copyTypedColumn<std::string>(classDescriptor, desc, sources, targets)
+			|| copyTypedColumn<G3D::Vector3>(classDescriptor, desc, sources, targets)
+			|| copyTypedColumn<G3D::Color3>(classDescriptor, desc, sources, targets)
+			|| copyTypedColumn<G3D::CoordinateFrame>(classDescriptor, desc, sources, targets))
+		{
+		}
+		else if (desc.hasStringValue())
+		{
+			for (size_t i = 0; i < sources.size(); ++i)
+				desc.setStringValue(targets[i], desc.getStringValue(sources[i]));
+		}
+	}
+
+	// Copies the streamed properties of each class in one pass per property. Refs are copied
+	// last, once every copy exists, the same way MergeBinder resolves IDREFs after a read
+	static void copyProperties(const std::vector<Instance*>& sources, const std::vector<boost::shared_ptr<Instance>>& copies)
+	{
+		std::map<const Reflection::ClassDescriptor*, std::vector<size_t>> classMembers;
+		for (size_t i = 0; i < sources.size(); ++i)
+			if (copies[i])
+				classMembers[&sources[i]->getDescriptor()].push_back(i);
+
+		CloneMap cloneMap(sources, copies);
+
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			bool refPass = pass == 1;
+
+			std::map<const Reflection::ClassDescriptor*, std::vector<size_t>>::const_iterator c;
+			for (c = classMembers.begin(); c != classMembers.end(); ++c)
 			{
-				Notifier<Instance, ChildAdded>::raise(ChildAdded((*iter).get()), listener);
+				const Reflection::ClassDescriptor& classDescriptor = *c->first;
+				const std::vector<size_t>& members = c->second;
+
+				std::vector<const Reflection::DescribedBase*> sourceColumn(members.size());
+				std::vector<Reflection::DescribedBase*> targetColumn(members.size());
+				for (size_t i = 0; i < members.size(); ++i)
+				{
+					sourceColumn[i] = sources[members[i]];
+					targetColumn[i] = copies[members[i]].get();
+				}
+
+				Reflection::ClassDescriptor::PropertyContainer::Collection::const_iterator iter = classDescriptor.Reflection::ClassDescriptor::PropertyContainer::descriptors_begin();
+				Reflection::ClassDescriptor::PropertyContainer::Collection::const_iterator end = classDescriptor.Reflection::ClassDescriptor::PropertyContainer::descriptors_end();
+				for (; iter != end; ++iter)
+				{
+					const Reflection::PropertyDescriptor& desc = **iter;
+					if (!desc.canStreamWrite() || desc.isReadOnly())
+						continue;
+
+					const Reflection::RefPropertyDescriptor* refDesc = dynamic_cast<const Reflection::RefPropertyDescriptor*>(&desc);
+					if ((refDesc != NULL) != refPass)
+						continue;
+
+					if (refDesc)
+					{
+						for (size_t i = 0; i < members.size(); ++i)
+							refDesc->setRefValue(targetColumn[i], cloneMap.remap(refDesc->getRefValue(sourceColumn[i])));
+					}
+					else
+					{
+						copyColumn(classDescriptor, desc, sourceColumn, targetColumn);
+					}
+				}
 			}
 		}
 	}
 
-	void Instance::removeAllChildren()
+	// Parents each copy's children in one batch, deepest first, so that a copy only joins its
+	// new parent once its own subtree is complete (as Instance::readChild does)
+	static void parentCopies(size_t index, const std::vector<std::vector<size_t>>& childIndices, const std::vector<boost::shared_ptr<Instance>>& copies)
+	{
+		const std::vector<size_t>& childList = childIndices[index];
+		if (childList.empty())
+			return;
+
+		std::vector<boost::shared_ptr<Instance>> batch;
+		batch.reserve(childList.size());
+
+		for (size_t i = 0; i < childList.size(); ++i)
+		{
+			parentCopies(childList[i], childIndices, copies);
+			batch.push_back(copies[childList[i]]);
+		}
+
+		copies[index]->addChildren(batch);
+	}
+
+	boost::shared_ptr<Instance> Instance::clone()
+	{
+		if (!archivable)
+			return boost::shared_ptr<Instance>();
+
+		// Archivable instances of the subtree in document order. Like the serializers, a
+		// non-archivable instance is left out along with its descendents
+		std::vector<Instance*> sources;
+		std::vector<size_t> parents;
+		std::vector<std::pair<Instance*, size_t>> stack(1, std::make_pair(this, (size_t)-1));
+		while (!stack.empty())
+		{
+			Instance* source = stack.back().first;
+			size_t parent = stack.back().second;
+			stack.pop_back();
+
+			size_t index = sources.size();
+			sources.push_back(source);
+			parents.push_back(parent);
+
+			for (size_t i = source->children.size(); i-- > 0; )
+			{
+				Instance* child = source->children[i].get();
+				if (child->archivable)
+					stack.push_back(std::make_pair(child, index));
+			}
+		}
+
+		// Children are created by their new parent, as they are when read from XML. A class
+		// that can't be created drops its subtree
+		std::vector<boost::shared_ptr<Instance>> copies(sources.size());
+		std::vector<std::vector<size_t>> childIndices(sources.size());
+
+		copies[0] = AbstractFactoryProduct<Instance>::create(getClassName());
+		if (!copies[0])
+			return boost::shared_ptr<Instance>();
+
+		for (size_t i = 1; i < sources.size(); ++i)
+		{
+			const boost::shared_ptr<Instance>& newParent = copies[parents[i]];
+			if (!newParent)
+				continue;
+
+			copies[i] = newParent->createChild(sources[i]->getClassName());
+			if (copies[i])
+				childIndices[parents[i]].push_back(i);
+		}
+
+		copyProperties(sources, copies);
+		parentCopies(0, childIndices, copies);
+
+		return copies[0];
+	}
+
+	// nameIndexMutex must be held for as long as the result is used
+	const Instance::NameIndex* Instance::getNameIndex() const
 	{
-		while (&(*children))
+		if (children.size() < NameIndex::threshold)
+			return NULL;
+
+		if (nameIndex.get() && nameIndex->removalCount != children.removalCount())
+			nameIndex.reset();
+
+		if (!nameIndex.get())
 		{
-			(*(children->end() - 1))->setParent(NULL);
+			nameIndex.reset(new NameIndex());
+			nameIndex->indexedCount = 0;
+			nameIndex->removalCount = children.removalCount();
 		}
+
+		for (size_t i = nameIndex->indexedCount; i < children.size(); ++i)
+			nameIndex->firstChild.insert(std::make_pair(children[i]->name.str(), i)); // keeps an earlier child with the same name
+
+		nameIndex->indexedCount = children.size();
+		return nameIndex.get();
+	}
+
+	Instance* Instance::findFirstChildByName(const std::string& findName) const
+	{
+		if (children.size() >= NameIndex::threshold)
+		{
+			boost::mutex::scoped_lock lock(nameIndexMutex);
+
+			const NameIndex* index = getNameIndex();
+			std::map<std::string, size_t>::const_iterator iter = index->firstChild.find(findName);
+			return iter != index->firstChild.end() ? children[iter->second].get() : NULL;
+		}
+
+		for (size_t i = 0; i < children.size(); ++i)
+		{
+			if (children[i]->name.str() == findName)
+				return children[i].get();
+		}
+
+		return NULL;
+	}
+
+	Instance* Instance::findFirstChildByNameRecursive(const std::string& findName) const
+	{
+		// Depth first, so a match inside an earlier child's subtree wins over a later direct child.
+		// The name index doesn't help here: every subtree in front of the first direct match has
+		// to be searched anyway, and the scan stops at that match by itself
+		for (size_t i = 0; i < children.size(); ++i)
+		{
+			Instance* child = children[i].get();
+			if (child->name.str() == findName)
+				return child;
+
+			if (Instance* found = child->findFirstChildByNameRecursive(findName))
+				return found;
+		}
+
+		return NULL;
+	}
+
+	boost::shared_ptr<Instance> Instance::findFirstChildByName2(std::string findName, bool recursive)
+	{
+		Instance* found = recursive ? findFirstChildByNameRecursive(findName) : findFirstChildByName(findName);
+		return found ? shared_from(found) : boost::shared_ptr<Instance>();
 	}
 
 	void Instance::onChildChanged(Instance* instance, const PropertyChanged& event)
@@ -219,12 +562,11 @@ namespace RBX
 
 	void Instance::remove()
 	{
-		boost::shared_ptr<const std::vector<boost::shared_ptr<Instance>>> r = children.read();
+		Children::Snapshot r = children.read();
 
 		setParent(NULL);
 
-		if (r)
-			std::for_each(r->begin(), r->end(), boost::bind(&Instance::remove, _1));
+		std::for_each(r.begin(), r.end(), boost::bind(&Instance::remove, _1));
 	}
 
 	void Instance::readChild(const XmlElement* childElement, IReferenceBinder& binder)
@@ -292,19 +634,16 @@ namespace RBX
 
 	void Instance::onAncestorChanged(const AncestorChanged& event)
 	{
-		typedef std::vector<boost::shared_ptr<Instance>>::const_iterator Iterator;
+		typedef Children::Snapshot::const_iterator Iterator;
 
-		if (&(*children))
+		Children::Snapshot r = children.read();
+		for (Iterator it = r.begin(); it != r.end(); it++)
 		{
-			boost::shared_ptr<const std::vector<boost::shared_ptr<Instance>>> r = children.read();
-
-			for (Iterator it = r->begin(); it != r->end(); it++)
-			{
-				(*it)->onAncestorChanged(event);
-			}
+			(*it)->onAncestorChanged(event);
 		}
 
-		event_ancestryChanged.fire(this, shared_from(event.oldParent));
+		if (!event_ancestryChanged.empty(this))
+			event_ancestryChanged.fire(this, shared_from(event.oldParent));
 		Notifier<Instance, AncestorChanged>::raise(event);
 	}
 }
@@ -4,6 +4,7 @@
 #include "v8world/Ball.h"
 #include "v8world/Block.h"
 #include "v8world/World.h"
+#include "v8world/SpatialHash.h"
 #include <cmath>
 
 namespace RBX 
@@ -178,6 +179,31 @@ namespace RBX
 		*surfaceData[id] = newSurfaceData;
 	}
 
+	void Primitive::reportMemory(MemoryReport& report, const Name& owner) const
+	{
+		report.add(MemoryReport::Primitives, owner, Memory::blockSize(this));
+		if (anchorObject)
+			report.add(MemoryReport::Primitives, owner, Memory::blockSize(anchorObject));
+
+		if (geometry)
+			report.add(MemoryReport::Geometries, owner, Memory::blockSize(geometry));
+
+		if (body)
+			body->reportMemory(report, owner);
+
+		for (int i = 0; i < 6; ++i)
+		{
+			if (surfaceData[i])
+				report.add(MemoryReport::Surfaces, owner, Memory::blockSize(surfaceData[i]));
+		}
+
+		// nodes come out of SpatialHash's own free list, so count them by size
+		size_t nodeCount = 0;
+		for (const SpatialNode* node = spatialNodes; node; node = node->nextPrimitiveLink)
+			++nodeCount;
+		report.add(MemoryReport::SpatialNodes, owner, nodeCount * sizeof(SpatialNode));
+	}
+
 	Edge* Primitive::getFirstEdge() const
 	{
 		return joints.first ? joints.first : contacts.first;
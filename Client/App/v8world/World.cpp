@@ -223,6 +223,16 @@ namespace RBX
 		touchOther.append(touchOtherP);
 	}
 
+	const G3D::Array<Primitive*>& World::getTouch() const
+	{
+		return touch;
+	}
+
+	const G3D::Array<Primitive*>& World::getTouchOther() const
+	{
+		return touchOther;
+	}
+
 	void World::createJoints(Primitive *p)
 	{
 		createJoints(p, NULL);
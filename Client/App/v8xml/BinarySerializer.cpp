@@ -0,0 +1,694 @@
+#include <windows.h>
+#include "v8xml/BinarySerializer.h"
+#include "v8xml/SerializerV2.h"
+#include "v8tree/Instance.h"
+#include "util/Debug.h"
+#include <G3D/CoordinateFrame.h>
+#include <G3D/Color3.h>
+#include <G3D/Vector3.h>
+#include <G3D/format.h>
+#include <boost/scoped_array.hpp>
+#include <map>
+
+namespace RBX
+{
+	const char BinarySerializer::MAGIC[8] = { '<', 'r', 'b', 'x', 'b', 'i', 'n', '>' };
+	const unsigned int BinarySerializer::VERSION = 1;
+
+	static size_t columnElementSize(BinarySerializer::ColumnType type)
+	{
+		switch (type)
+		{
+		case BinarySerializer::COLUMN_BOOL:
+			return 1;
+		case BinarySerializer::COLUMN_STRING:
+		case BinarySerializer::COLUMN_INT:
+		case BinarySerializer::COLUMN_FLOAT:
+		case BinarySerializer::COLUMN_ENUM:
+		case BinarySerializer::COLUMN_REF:
+			return 4;
+		case BinarySerializer::COLUMN_VECTOR3:
+		case BinarySerializer::COLUMN_COLOR3:
+			return 12;
+		case BinarySerializer::COLUMN_CFRAME:
+			return 48;
+		default:
+			throw std::runtime_error("BinarySerializer: unknown column type");
+		}
+	}
+
+	// Returns false for properties that the binary format does not store
+	static bool columnTypeOf(const Reflection::PropertyDescriptor& desc, BinarySerializer::ColumnType& type)
+	{
+		if (dynamic_cast<const Reflection::RefPropertyDescriptor*>(&desc))
+			type = BinarySerializer::COLUMN_REF;
+		else if (dynamic_cast<const Reflection::EnumPropertyDescriptor*>(&desc))
+			type = BinarySerializer::COLUMN_ENUM;
+		else if (&desc.type == &Reflection::Type::singleton<bool>())
+			type = BinarySerializer::COLUMN_BOOL;
+		else if (&desc.type == &Reflection::Type::singleton<int>())
+			type = BinarySerializer::COLUMN_INT;
+		else if (&desc.type == &Reflection::Type::singleton<float>())
+			type = BinarySerializer::COLUMN_FLOAT;
+		else if (&desc.type == &Reflection::Type::singleton<G3D::Vector3>())
+			type = BinarySerializer::COLUMN_VECTOR3;
+		else if (&desc.type == &Reflection::Type::singleton<G3D::Color3>())
+			type = BinarySerializer::COLUMN_COLOR3;
+		else if (&desc.type == &Reflection::Type::singleton<G3D::CoordinateFrame>())
+			type = BinarySerializer::COLUMN_CFRAME;
+		else if (desc.hasStringValue())
+			type = BinarySerializer::COLUMN_STRING;
+		else
+			return false;
+
+		return true;
+	}
+
+	class BinaryStringTable
+	{
+	private:
+		std::map<std::string, unsigned int> index;
+		std::vector<const std::string*> strings;
+
+	public:
+		unsigned int add(const std::string& s)
+		{
+			std::map<std::string, unsigned int>::iterator iter = index.find(s);
+			if (iter != index.end())
+				return iter->second;
+
+			unsigned int i = (unsigned int)strings.size();
+			iter = index.insert(std::make_pair(s, i)).first;
+			strings.push_back(&iter->first);
+			return i;
+		}
+
+		void write(std::ostream& stream) const
+		{
+			unsigned int count = (unsigned int)strings.size();
+			stream.write((const char*)&count, sizeof(count));
+
+			for (size_t i = 0; i < strings.size(); ++i)
+			{
+				unsigned int length = (unsigned int)strings[i]->size();
+				stream.write((const char*)&length, sizeof(length));
+				stream.write(strings[i]->data(), length);
+			}
+		}
+	};
+
+	class BinaryColumnWriter
+	{
+	private:
+		std::string& buffer;
+
+	public:
+		BinaryColumnWriter(std::string& buffer)
+			: buffer(buffer)
+		{
+		}
+
+		template<typename T>
+		void write(const T& value)
+		{
+			buffer.append((const char*)&value, sizeof(T));
+		}
+
+		void write(bool value)
+		{
+			buffer += value ? '\1' : '\0';
+		}
+
+		void write(const G3D::Vector3& value)
+		{
+			write(value.x);
+			write(value.y);
+			write(value.z);
+		}
+
+		void write(const G3D::Color3& value)
+		{
+			write(value.r);
+			write(value.g);
+			write(value.b);
+		}
+
+		void write(const G3D::CoordinateFrame& value)
+		{
+			for (int r = 0; r < 3; ++r)
+				for (int c = 0; c < 3; ++c)
+					write(value.rotation[r][c]);
+			write(value.translation);
+		}
+	};
+
+	class BinaryReader
+	{
+	private:
+		const char* current;
+		const char* end;
+
+	public:
+		BinaryReader(const char* data, size_t size)
+			: current(data),
+			  end(data + size)
+		{
+		}
+
+		const char* skip(size_t size)
+		{
+			if ((size_t)(end - current) < size)
+				throw std::runtime_error("BinarySerializer: unexpected end of data");
+
+			const char* result = current;
+			current += size;
+			return result;
+		}
+
+		// count elements of elementSize bytes, checked for overflow before anything is skipped
+		const char* skipArray(size_t count, size_t elementSize)
+		{
+			require(count, elementSize);
+			return skip(count * elementSize);
+		}
+
+		// Throws unless count elements of at least elementSize bytes could still follow. Counts are
+		// checked with this before anything is sized from them
+		void require(size_t count, size_t elementSize) const
+		{
+			if (elementSize != 0 && count > (size_t)(end - current) / elementSize)
+				throw std::runtime_error("BinarySerializer: unexpected end of data");
+		}
+
+		template<typename T>
+		T read()
+		{
+			T value;
+			memcpy(&value, skip(sizeof(T)), sizeof(T));
+			return value;
+		}
+	};
+
+	template<typename T>
+	static T readValue(const char* data)
+	{
+		T value;
+		memcpy(&value, data, sizeof(T));
+		return value;
+	}
+
+	template<>
+	bool readValue<bool>(const char* data)
+	{
+		return *data != 0;
+	}
+
+	template<>
+	G3D::Vector3 readValue<G3D::Vector3>(const char* data)
+	{
+		float v[3];
+		memcpy(v, data, sizeof(v));
+		return G3D::Vector3(v[0], v[1], v[2]);
+	}
+
+	template<>
+	G3D::Color3 readValue<G3D::Color3>(const char* data)
+	{
+		float v[3];
+		memcpy(v, data, sizeof(v));
+		return G3D::Color3(v[0], v[1], v[2]);
+	}
+
+	template<>
+	G3D::CoordinateFrame readValue<G3D::CoordinateFrame>(const char* data)
+	{
+		float v[12];
+		memcpy(v, data, sizeof(v));
+
+		G3D::CoordinateFrame cframe;
+		for (int r = 0; r < 3; ++r)
+			for (int c = 0; c < 3; ++c)
+				cframe.rotation[r][c] = v[r * 3 + c];
+		cframe.translation = G3D::Vector3(v[9], v[10], v[11]);
+		return cframe;
+	}
+
+	static void collectInstances(Instance* instance, int parentIndex, std::vector<Instance*>& instances, std::vector<int>& parents)
+	{
+		if (!Instance::propArchivable.getValue(instance))
+			return;
+
+		int index = (int)instances.size();
+		instances.push_back(instance);
+		parents.push_back(parentIndex);
+
+		for (size_t i = 0; i < instance->numChildren(); ++i)
+			collectInstances(instance->getChild(i), index, instances, parents);
+	}
+
+	template<typename T>
+	static void writeTypedColumn(BinaryColumnWriter& writer, const Reflection::ClassDescriptor& classDescriptor, const Reflection::PropertyDescriptor& desc, const std::vector<const Reflection::DescribedBase*>& members)
+	{
+		boost::scoped_array<T> values(new T[members.size()]);
+		classDescriptor.getPropertyColumn(static_cast<const Reflection::TypedPropertyDescriptor<T>&>(desc), &members[0], members.size(), values.get());
+
+		for (size_t i = 0; i < members.size(); ++i)
+			writer.write(values[i]);
+	}
+
+	static void writeColumn(BinaryColumnWriter& writer, BinarySerializer::ColumnType type, const Reflection::ClassDescriptor& classDescriptor, const Reflection::PropertyDescriptor& desc, const std::vector<const Reflection::DescribedBase*>& members, BinaryStringTable& strings, const std::map<const Reflection::DescribedBase*, int>& indices)
+	{
+		switch (type)
+		{
+		case BinarySerializer::COLUMN_BOOL:
+			writeTypedColumn<bool>(writer, classDescriptor, desc, members);
+			break;
+		case BinarySerializer::COLUMN_INT:
+			writeTypedColumn<int>(writer, classDescriptor, desc, members);
+			break;
+		case BinarySerializer::COLUMN_FLOAT:
+			writeTypedColumn<float>(writer, classDescriptor, desc, members);
+			break;
+		case BinarySerializer::COLUMN_VECTOR3:
+			writeTypedColumn<G3D::Vector3>(writer, classDescriptor, desc, members);
+			break;
+		case BinarySerializer::COLUMN_COLOR3:
+			writeTypedColumn<G3D::Color3>(writer, classDescriptor, desc, members);
+			break;
+		case BinarySerializer::COLUMN_CFRAME:
+			writeTypedColumn<G3D::CoordinateFrame>(writer, classDescriptor, desc, members);
+			break;
+		case BinarySerializer::COLUMN_ENUM:
+			for (size_t i = 0; i < members.size(); ++i)
+				writer.write(static_cast<const Reflection::EnumPropertyDescriptor&>(desc).getEnumValue(members[i]));
+			break;
+		case BinarySerializer::COLUMN_REF:
+			for (size_t i = 0; i < members.size(); ++i)
+			{
+				// references to instances outside of the saved set are stored as null
+				const Reflection::DescribedBase* target = static_cast<const Reflection::RefPropertyDescriptor&>(desc).getRefValue(members[i]);
+				std::map<const Reflection::DescribedBase*, int>::const_iterator iter = indices.find(target);
+				writer.write(iter != indices.end() ? iter->second : -1);
+			}
+			break;
+		default:
+			for (size_t i = 0; i < members.size(); ++i)
+				writer.write(strings.add(desc.getStringValue(members[i])));
+			break;
+		}
+	}
+
+	bool BinarySerializer::isBinary(const char* data, size_t size)
+	{
+		return size >= sizeof(MAGIC) && memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+	}
+
+	bool BinarySerializer::isBinary(std::istream& stream)
+	{
+		char header[sizeof(MAGIC)];
+		stream.read(header, sizeof(header));
+		size_t count = (size_t)stream.gcount();
+
+		stream.clear();
+		stream.seekg(-(std::streamoff)count, std::ios_base::cur);
+
+		return isBinary(header, count);
+	}
+
+	void BinarySerializer::save(std::ostream& stream, const std::vector<boost::shared_ptr<Instance>>& roots)
+	{
+		std::vector<Instance*> instances;
+		std::vector<int> parents;
+		for (size_t i = 0; i < roots.size(); ++i)
+			collectInstances(roots[i].get(), -1, instances, parents);
+
+		std::map<const Reflection::DescribedBase*, int> indices;
+		for (size_t i = 0; i < instances.size(); ++i)
+			indices[instances[i]] = (int)i;
+
+		// Group instances into one chunk per class, preserving document order
+		BinaryStringTable strings;
+		std::map<const Name*, unsigned int> classIndices;
+		std::vector<std::vector<const Instance*>> classMembers;
+		std::vector<unsigned int> instanceClasses(instances.size());
+
+		for (size_t i = 0; i < instances.size(); ++i)
+		{
+			const Name* className = &instances[i]->getClassName();
+			std::map<const Name*, unsigned int>::iterator iter = classIndices.find(className);
+			if (iter == classIndices.end())
+			{
+				iter = classIndices.insert(std::make_pair(className, (unsigned int)classMembers.size())).first;
+				classMembers.push_back(std::vector<const Instance*>());
+			}
+
+			instanceClasses[i] = iter->second;
+			classMembers[iter->second].push_back(instances[i]);
+		}
+
+		// Build the property columns of each class chunk
+		std::vector<std::string> chunks(classMembers.size());
+		for (size_t c = 0; c < classMembers.size(); ++c)
+		{
+			std::vector<const Reflection::DescribedBase*> members(classMembers[c].begin(), classMembers[c].end());
+			const Reflection::ClassDescriptor& classDescriptor = classMembers[c][0]->getDescriptor();
+
+			std::string columns;
+			BinaryColumnWriter writer(columns);
+			unsigned int propertyCount = 0;
+
+			Reflection::ClassDescriptor::PropertyContainer::Collection::const_iterator iter = classDescriptor.Reflection::ClassDescriptor::PropertyContainer::descriptors_begin();
+			Reflection::ClassDescriptor::PropertyContainer::Collection::const_iterator end = classDescriptor.Reflection::ClassDescriptor::PropertyContainer::descriptors_end();
+			for (; iter != end; ++iter)
+			{
+				const Reflection::PropertyDescriptor& desc = **iter;
+
+				ColumnType type;
+				if (!desc.canStreamWrite() || desc.isReadOnly() || !columnTypeOf(desc, type))
+					continue;
+
+				writer.write(strings.add(desc.name.name));
+				writer.write((unsigned char)type);
+				writeColumn(writer, type, classDescriptor, desc, members, strings, indices);
+
+				++propertyCount;
+			}
+
+			std::string& chunk = chunks[c];
+			BinaryColumnWriter chunkWriter(chunk);
+			chunkWriter.write(strings.add(classDescriptor.name.name));
+			chunkWriter.write(propertyCount);
+			chunk += columns;
+		}
+
+		stream.write(MAGIC, sizeof(MAGIC));
+		stream.write((const char*)&VERSION, sizeof(VERSION));
+
+		unsigned int instanceCount = (unsigned int)instances.size();
+		unsigned int classCount = (unsigned int)chunks.size();
+		stream.write((const char*)&instanceCount, sizeof(instanceCount));
+		stream.write((const char*)&classCount, sizeof(classCount));
+
+		strings.write(stream);
+
+		for (size_t i = 0; i < instances.size(); ++i)
+		{
+			stream.write((const char*)&instanceClasses[i], sizeof(unsigned int));
+			stream.write((const char*)&parents[i], sizeof(int));
+		}
+
+		for (size_t c = 0; c < chunks.size(); ++c)
+			stream.write(chunks[c].data(), (std::streamsize)chunks[c].size());
+	}
+
+	template<typename T>
+	static void applyTypedColumn(const Reflection::ClassDescriptor& classDescriptor, const Reflection::PropertyDescriptor& desc, const std::vector<Reflection::DescribedBase*>& objects, const std::vector<size_t>& rows, const char* column, size_t elementSize)
+	{
+		boost::scoped_array<T> values(new T[objects.size()]);
+		for (size_t i = 0; i < objects.size(); ++i)
+			values[i] = readValue<T>(column + rows[i] * elementSize);
+
+		classDescriptor.setPropertyColumn(static_cast<const Reflection::TypedPropertyDescriptor<T>&>(desc), &objects[0], objects.size(), values.get());
+	}
+
+	// objects are the instances of the class that were created, rows their positions in the column
+	static void applyColumn(BinarySerializer::ColumnType type, const Reflection::ClassDescriptor& classDescriptor, const Reflection::PropertyDescriptor& desc, const std::vector<Reflection::DescribedBase*>& objects, const std::vector<size_t>& rows, const char* column, size_t elementSize, const std::vector<std::string>& strings, const std::vector<boost::shared_ptr<Instance>>& instances)
+	{
+		switch (type)
+		{
+		case BinarySerializer::COLUMN_BOOL:
+			applyTypedColumn<bool>(classDescriptor, desc, objects, rows, column, elementSize);
+			break;
+		case BinarySerializer::COLUMN_INT:
+			applyTypedColumn<int>(classDescriptor, desc, objects, rows, column, elementSize);
+			break;
+		case BinarySerializer::COLUMN_FLOAT:
+			applyTypedColumn<float>(classDescriptor, desc, objects, rows, column, elementSize);
+			break;
+		case BinarySerializer::COLUMN_VECTOR3:
+			applyTypedColumn<G3D::Vector3>(classDescriptor, desc, objects, rows, column, elementSize);
+			break;
+		case BinarySerializer::COLUMN_COLOR3:
+			applyTypedColumn<G3D::Color3>(classDescriptor, desc, objects, rows, column, elementSize);
+			break;
+		case BinarySerializer::COLUMN_CFRAME:
+			applyTypedColumn<G3D::CoordinateFrame>(classDescriptor, desc, objects, rows, column, elementSize);
+			break;
+		case BinarySerializer::COLUMN_ENUM:
+			for (size_t i = 0; i < objects.size(); ++i)
+				static_cast<const Reflection::EnumPropertyDescriptor&>(desc).setEnumValue(objects[i], readValue<int>(column + rows[i] * elementSize));
+			break;
+		case BinarySerializer::COLUMN_REF:
+			for (size_t i = 0; i < objects.size(); ++i)
+			{
+				int target = readValue<int>(column + rows[i] * elementSize);
+				if (target >= (int)instances.size())
+					throw std::runtime_error("BinarySerializer: referent out of range");
+
+				static_cast<const Reflection::RefPropertyDescriptor&>(desc).setRefValue(objects[i], target >= 0 ? instances[target].get() : NULL);
+			}
+			break;
+		default:
+			for (size_t i = 0; i < objects.size(); ++i)
+			{
+				unsigned int index = readValue<unsigned int>(column + rows[i] * elementSize);
+				if (index >= strings.size())
+					throw std::runtime_error("BinarySerializer: string index out of range");
+
+				desc.setStringValue(objects[i], strings[index]);
+			}
+			break;
+		}
+	}
+
+	// Parents children before their parent and siblings in document order, the same order readChild uses
+	static void parentSubtree(int index, const std::vector<std::vector<int>>& children, const std::vector<boost::shared_ptr<Instance>>& instances)
+	{
+		const std::vector<int>& c = children[index];
+		for (size_t i = 0; i < c.size(); ++i)
+		{
+			parentSubtree(c[i], children, instances);
+			instances[c[i]]->setParent(instances[index].get());
+		}
+	}
+
+	void BinarySerializer::load(const char* data, size_t size, Instance* root, std::vector<boost::shared_ptr<Instance>>& result)
+	{
+		if (!isBinary(data, size))
+			throw std::runtime_error("BinarySerializer: bad header");
+
+		BinaryReader reader(data, size);
+		reader.skip(sizeof(MAGIC));
+
+		unsigned int version = reader.read<unsigned int>();
+		if (version != VERSION)
+			throw std::runtime_error(G3D::format("BinarySerializer: unsupported version %d", version));
+
+		unsigned int instanceCount = reader.read<unsigned int>();
+		unsigned int classCount = reader.read<unsigned int>();
+
+		unsigned int stringCount = reader.read<unsigned int>();
+		reader.require(stringCount, sizeof(unsigned int));
+		std::vector<std::string> strings(stringCount);
+		for (unsigned int i = 0; i < stringCount; ++i)
+		{
+			unsigned int length = reader.read<unsigned int>();
+			strings[i].assign(reader.skip(length), length);
+		}
+
+		// each instance takes a class and a parent, each class chunk a name and a property count
+		reader.require(instanceCount, sizeof(unsigned int) + sizeof(int));
+		reader.require(classCount, 2 * sizeof(unsigned int));
+		reader.require((size_t)instanceCount + classCount, 2 * sizeof(unsigned int));
+
+		// Create every instance up front so that Ref columns can point forwards
+		std::vector<unsigned int> instanceClasses(instanceCount);
+		std::vector<int> parents(instanceCount);
+		std::vector<const Name*> classNames(classCount, (const Name*)NULL);
+		std::vector<boost::shared_ptr<Instance>> instances(instanceCount);
+		std::vector<std::vector<int>> children(instanceCount);
+		std::vector<std::vector<Instance*>> classMembers(classCount);
+
+		std::vector<size_t> memberCounts(classCount, 0);
+
+		for (unsigned int i = 0; i < instanceCount; ++i)
+		{
+			instanceClasses[i] = reader.read<unsigned int>();
+			parents[i] = reader.read<int>();
+
+			if (instanceClasses[i] >= classCount || parents[i] < -1 || parents[i] >= (int)i)
+				throw std::runtime_error("BinarySerializer: corrupt instance table");
+
+			++memberCounts[instanceClasses[i]];
+		}
+
+		// Class names are stored in the chunks, so peek at each chunk header first
+		BinaryReader chunkReader = reader;
+		std::vector<BinaryReader> chunkStarts;
+		for (unsigned int c = 0; c < classCount; ++c)
+		{
+			chunkStarts.push_back(chunkReader);
+
+			unsigned int nameIndex = chunkReader.read<unsigned int>();
+			if (nameIndex >= stringCount)
+				throw std::runtime_error("BinarySerializer: string index out of range");
+			classNames[c] = &Name::lookup(strings[nameIndex]);
+
+			unsigned int propertyCount = chunkReader.read<unsigned int>();
+			for (unsigned int p = 0; p < propertyCount; ++p)
+			{
+				chunkReader.read<unsigned int>();
+				ColumnType type = (ColumnType)chunkReader.read<unsigned char>();
+				chunkReader.skipArray(memberCounts[c], columnElementSize(type));
+			}
+		}
+
+		for (unsigned int i = 0; i < instanceCount; ++i)
+		{
+			const Name& className = *classNames[instanceClasses[i]];
+
+			boost::shared_ptr<Instance> instance;
+			if (parents[i] >= 0)
+			{
+				// the subtree of an instance that could not be created is dropped
+				Instance* parent = instances[parents[i]].get();
+				if (parent)
+					instance = parent->createChild(className);
+			}
+			else
+			{
+				instance = root ? root->createChild(className) : AbstractFactoryProduct<Instance>::create(className);
+			}
+
+			instances[i] = instance;
+			classMembers[instanceClasses[i]].push_back(instance.get());
+			if (parents[i] >= 0 && instance)
+				children[parents[i]].push_back((int)i);
+		}
+
+		// Apply the property columns, one descriptor lookup per column
+		for (unsigned int c = 0; c < classCount; ++c)
+		{
+			BinaryReader& chunk = chunkStarts[c];
+			chunk.read<unsigned int>();
+			unsigned int propertyCount = chunk.read<unsigned int>();
+
+			const std::vector<Instance*>& members = classMembers[c];
+
+			// instances that could not be created keep their rows in the columns but are skipped
+			std::vector<Reflection::DescribedBase*> objects;
+			std::vector<size_t> rows;
+			for (size_t i = 0; i < members.size(); ++i)
+			{
+				if (members[i])
+				{
+					objects.push_back(members[i]);
+					rows.push_back(i);
+				}
+			}
+
+			const Reflection::ClassDescriptor* classDescriptor = objects.empty() ? NULL : &objects[0]->getDescriptor();
+
+			for (unsigned int p = 0; p < propertyCount; ++p)
+			{
+				unsigned int nameIndex = chunk.read<unsigned int>();
+				ColumnType storedType = (ColumnType)chunk.read<unsigned char>();
+				size_t elementSize = columnElementSize(storedType);
+				const char* column = chunk.skip(elementSize * members.size());
+
+				if (!classDescriptor || nameIndex >= stringCount)
+					continue;
+
+				const Name& propertyName = Name::lookup(strings[nameIndex]);
+				Reflection::ClassDescriptor::PropertyContainer::Collection::const_iterator iter = classDescriptor->Reflection::ClassDescriptor::PropertyContainer::findDescriptor(propertyName);
+				if (iter == classDescriptor->Reflection::ClassDescriptor::PropertyContainer::descriptors_end())
+					continue;
+
+				const Reflection::PropertyDescriptor& desc = **iter;
+				if (desc.isReadOnly())
+					continue;
+
+				// A property whose type changed since the file was written can still be set from a string
+				ColumnType type;
+				if (!columnTypeOf(desc, type) || (type != storedType && !(storedType == COLUMN_STRING && desc.hasStringValue())))
+					continue;
+
+				applyColumn(storedType, *classDescriptor, desc, objects, rows, column, elementSize, strings, instances);
+			}
+		}
+
+		for (unsigned int i = 0; i < instanceCount; ++i)
+		{
+			if (parents[i] < 0 && instances[i])
+			{
+				parentSubtree((int)i, children, instances);
+				if (root)
+					instances[i]->setParent(root);
+				result.push_back(instances[i]);
+			}
+		}
+	}
+
+	void BinarySerializer::loadFile(const std::string& fileName, Instance* root, std::vector<boost::shared_ptr<Instance>>& result)
+	{
+		MappedFile file(fileName);
+		load(file.data(), file.length(), root, result);
+	}
+
+	void BinarySerializer::convertXmlToBinary(std::istream& xml, std::ostream& binary)
+	{
+		std::vector<boost::shared_ptr<Instance>> instances;
+		SerializerV2().loadInstances(xml, instances);
+
+		save(binary, instances);
+	}
+
+	void BinarySerializer::convertBinaryToXml(const char* data, size_t size, std::ostream& xml)
+	{
+		std::vector<boost::shared_ptr<Instance>> instances;
+		load(data, size, NULL, instances);
+
+		std::auto_ptr<XmlElement> root(SerializerV2::newRootElement());
+		for (size_t i = 0; i < instances.size(); ++i)
+			root->addChild(instances[i]->write());
+
+		TextXmlWriter writer(xml);
+		writer.serialize(root.get());
+	}
+
+	MappedFile::MappedFile(const std::string& fileName)
+		: file(INVALID_HANDLE_VALUE),
+		  mapping(NULL),
+		  view(NULL),
+		  size(0)
+	{
+		file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error(G3D::format("Unable to open %s", fileName.c_str()));
+
+		size = GetFileSize(file, NULL);
+		if (size > 0)
+		{
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping)
+				view = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+			if (!view)
+			{
+				if (mapping)
+					CloseHandle(mapping);
+				CloseHandle(file);
+				throw std::runtime_error(G3D::format("Unable to map %s", fileName.c_str()));
+			}
+		}
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (view)
+			UnmapViewOfFile(view);
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+	}
+}
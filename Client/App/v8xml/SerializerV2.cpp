@@ -1,6 +1,10 @@
 #include "v8xml/SerializerV2.h"
 #include "v8tree/Instance.h"
+#include "util/boost.hpp"
+#include <G3D/CoordinateFrame.h>
+#include <G3D/Color3.h>
 #include <boost/bind.hpp>
+#include <boost/checked_delete.hpp>
 #include <algorithm>
 
 namespace RBX
@@ -69,6 +73,406 @@ namespace RBX
 	}
 }
 
+namespace RBX
+{
+	XmlInstanceReader::XmlInstanceReader(Instance* root, IReferenceBinder& binder)
+		: root(root),
+		  binder(binder)
+	{
+	}
+
+	XmlInstanceReader::~XmlInstanceReader()
+	{
+		// property subtrees left open by a failed parse
+		for (size_t i = 1; i < frames.size(); ++i)
+		{
+			if (frames[i].type == Frame::PROPERTY && frames[i - 1].type == Frame::PROPERTIES)
+				delete frames[i].element;
+		}
+
+		std::for_each(retained.begin(), retained.end(), boost::checked_deleter<XmlElement>());
+	}
+
+	void XmlInstanceReader::startElement(XmlElement* element)
+	{
+		Frame::Type parentType = frames.empty() ? Frame::IGNORED : frames.back().type;
+
+		if (parentType == Frame::PROPERTY)
+		{
+			frames.back().element->pushBackChild(element);
+			frames.push_back(Frame(Frame::PROPERTY, frames.back().instance, element));
+		}
+		else if (parentType == Frame::PROPERTIES)
+		{
+			frames.push_back(Frame(Frame::PROPERTY, frames.back().instance, element));
+		}
+		else
+		{
+			std::auto_ptr<XmlElement> owner(element);
+
+			if (element->getTag() == tag_Item && (parentType == Frame::ITEM || frames.size() == 1))
+				startItem(element);
+			else if (element->getTag() == tag_Properties && parentType == Frame::ITEM)
+				frames.push_back(Frame(Frame::PROPERTIES, frames.back().instance, NULL));
+			else
+				frames.push_back(Frame(Frame::IGNORED, boost::shared_ptr<Instance>(), NULL));
+		}
+	}
+
+	void XmlInstanceReader::startItem(XmlElement* element)
+	{
+		bool topLevel = frames.size() == 1;
+		Instance* parent = topLevel ? root : frames.back().instance.get();
+
+		boost::shared_ptr<Instance> instance;
+
+		// the children of an Item that could not be created are dropped, as in readChild
+		const Name* className = NULL;
+		const XmlAttribute* classAttrib = element->findAttribute(tag_class);
+		if ((topLevel || parent) && classAttrib && classAttrib->getValue(className))
+		{
+			instance = parent ? parent->createChild(*className) : AbstractFactoryProduct<Instance>::create(*className);
+
+			const XmlAttribute* nameRef = element->findAttribute(name_referent);
+			if (nameRef)
+				binder.announceID(nameRef, instance.get());
+		}
+
+		frames.push_back(Frame(Frame::ITEM, instance, NULL));
+	}
+
+	void XmlInstanceReader::endElement()
+	{
+		Frame frame = frames.back();
+		frames.pop_back();
+
+		switch (frame.type)
+		{
+		case Frame::ITEM:
+			if (frame.instance)
+				endItem(frame.instance);
+			break;
+		case Frame::PROPERTY:
+			if (frames.back().type == Frame::PROPERTIES)
+			{
+				if (frame.instance)
+					frame.instance->readProperty(frame.element, binder);
+
+				if (frame.instance && frame.element->getTag() == name_Ref)
+					retained.push_back(frame.element);
+				else
+					delete frame.element;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	void XmlInstanceReader::endItem(const boost::shared_ptr<Instance>& instance)
+	{
+		if (frames.size() == 1)
+		{
+			if (root)
+				instance->setParent(root);
+			instances.push_back(instance);
+		}
+		else
+		{
+			instance->setParent(frames.back().instance.get());
+		}
+	}
+}
+
+namespace RBX
+{
+	// Items per parallel_for iteration
+	static const size_t parallelReadBatch = 64;
+
+	static bool parseFloat(const XmlNameValuePair* value, float& result)
+	{
+		std::string text;
+		if (!value || !value->getValue(text) || text.empty())
+			return false;
+
+		char* end;
+		result = (float)strtod(text.c_str(), &end);
+		return *end == '\0';
+	}
+
+	static bool parseFloats(const XmlElement* element, const Name* const* tags, int count, float* result)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			if (!parseFloat(element->findFirstChildByTag(*tags[i]), result[i]))
+				return false;
+		}
+		return true;
+	}
+
+	template<typename T>
+	static void setStaged(const Reflection::PropertyDescriptor& desc, Instance* instance, const T& value)
+	{
+		static_cast<const Reflection::TypedPropertyDescriptor<T>&>(desc).setValue(instance, value);
+	}
+
+	XmlParallelReader::XmlParallelReader(Instance* root, IReferenceBinder& binder)
+		: root(root),
+		  binder(binder)
+	{
+	}
+
+	void XmlParallelReader::read(const XmlElement* container)
+	{
+		if (!container)
+			return;
+
+		items.clear();
+		topLevel.clear();
+
+		create(container, root, topLevel);
+
+		size_t batches = (items.size() + parallelReadBatch - 1) / parallelReadBatch;
+		thread_pool::singleton().parallel_for(batches, boost::bind(&XmlParallelReader::decodeRange, this, _1));
+
+		for (size_t i = 0; i < topLevel.size(); ++i)
+		{
+			apply(topLevel[i]);
+
+			const boost::shared_ptr<Instance>& instance = items[topLevel[i]].instance;
+			if (instance)
+			{
+				if (root)
+					instance->setParent(root);
+				instances.push_back(instance);
+			}
+		}
+	}
+
+	void XmlParallelReader::create(const XmlElement* container, Instance* parent, std::vector<size_t>& created)
+	{
+		for (const XmlElement* child = container->findFirstChildByTag(tag_Item); child != NULL; child = container->findNextChildWithSameTag(child))
+		{
+			size_t index = items.size();
+			items.push_back(Item());
+			items[index].element = child;
+			created.push_back(index);
+
+			const Name* className = NULL;
+			const XmlAttribute* classAttrib = child->findAttribute(tag_class);
+			if (!classAttrib || !classAttrib->getValue(className))
+				continue;
+
+			boost::shared_ptr<Instance> instance = parent ? parent->createChild(*className) : AbstractFactoryProduct<Instance>::create(*className);
+			if (!instance)
+				continue;
+
+			items[index].instance = instance;
+
+			const XmlElement* properties = child->findFirstChildByTag(tag_Properties);
+			if (properties)
+			{
+				for (const XmlElement* element = properties->firstChild(); element != NULL; element = element->nextSibling())
+				{
+					StagedProperty property;
+					property.element = element;
+					property.desc = NULL;
+					property.type = STAGED_NONE;
+					items[index].properties.push_back(property);
+				}
+			}
+
+			std::vector<size_t> children;
+			create(child, instance.get(), children);
+			items[index].children.swap(children);
+		}
+	}
+
+	void XmlParallelReader::decodeRange(size_t batch)
+	{
+		size_t end = std::min(items.size(), (batch + 1) * parallelReadBatch);
+		for (size_t i = batch * parallelReadBatch; i < end; ++i)
+		{
+			Item& item = items[i];
+			if (!item.instance || !item.instance->canStageProperties())
+				continue;
+
+			const Reflection::ClassDescriptor& classDescriptor = item.instance->getDescriptor();
+			for (size_t j = 0; j < item.properties.size(); ++j)
+			{
+				if (!decode(item.properties[j], classDescriptor))
+					item.properties[j].type = STAGED_NONE;
+			}
+		}
+	}
+
+	// Values that do not decode cleanly are left to readProperty on the calling thread
+	bool XmlParallelReader::decode(StagedProperty& property, const Reflection::ClassDescriptor& classDescriptor)
+	{
+		static const Name* const vectorTags[] = { &tag_X, &tag_Y, &tag_Z };
+		static const Name* const colorTags[] = { &tag_R, &tag_G, &tag_B };
+		static const Name* const cframeTags[] = { &tag_X, &tag_Y, &tag_Z, &tag_R00, &tag_R01, &tag_R02, &tag_R10, &tag_R11, &tag_R12, &tag_R20, &tag_R21, &tag_R22 };
+
+		const XmlElement* element = property.element;
+
+		const Name* name = NULL;
+		if (!element->findAttributeValue(name_name, name))
+			return false;
+
+		Reflection::ClassDescriptor::PropertyContainer::Collection::const_iterator iter = classDescriptor.Reflection::ClassDescriptor::PropertyContainer::findDescriptor(*name);
+		if (iter == classDescriptor.Reflection::ClassDescriptor::PropertyContainer::descriptors_end())
+			return false;
+
+		const Reflection::PropertyDescriptor& desc = **iter;
+		if (desc.isReadOnly() || element->getTag() != desc.type.tag)
+			return false;
+
+		const Reflection::Type* type = &desc.type;
+		if (type == &Reflection::Type::singleton<bool>())
+		{
+			std::string text;
+			if (!element->getValue(text) || (text != "true" && text != "false"))
+				return false;
+
+			property.boolValue = text == "true";
+			property.type = STAGED_BOOL;
+		}
+		else if (type == &Reflection::Type::singleton<int>())
+		{
+			std::string text;
+			if (!element->getValue(text) || text.empty())
+				return false;
+
+			char* end;
+			property.intValue = strtol(text.c_str(), &end, 10);
+			if (*end != '\0')
+				return false;
+
+			property.type = STAGED_INT;
+		}
+		else if (type == &Reflection::Type::singleton<float>())
+		{
+			if (!parseFloat(element, property.floatValues[0]))
+				return false;
+
+			property.type = STAGED_FLOAT;
+		}
+		else if (type == &Reflection::Type::singleton<G3D::Vector3>())
+		{
+			if (!parseFloats(element, vectorTags, 3, property.floatValues))
+				return false;
+
+			property.type = STAGED_VECTOR3;
+		}
+		else if (type == &Reflection::Type::singleton<G3D::Color3>())
+		{
+			if (!parseFloats(element, colorTags, 3, property.floatValues))
+				return false;
+
+			property.type = STAGED_COLOR3;
+		}
+		else if (type == &Reflection::Type::singleton<G3D::CoordinateFrame>())
+		{
+			if (!parseFloats(element, cframeTags, 12, property.floatValues))
+				return false;
+
+			property.type = STAGED_CFRAME;
+		}
+		else
+		{
+			return false;
+		}
+
+		property.desc = &desc;
+		return true;
+	}
+
+	void XmlParallelReader::apply(size_t index)
+	{
+		Item& item = items[index];
+		Instance* instance = item.instance.get();
+
+		if (!instance)
+		{
+			const Name* className = NULL;
+			const XmlAttribute* classAttrib = item.element->findAttribute(tag_class);
+			const XmlAttribute* nameRef = item.element->findAttribute(name_referent);
+			if (classAttrib && classAttrib->getValue(className) && nameRef)
+				binder.announceID(nameRef, NULL);
+			return;
+		}
+
+		const XmlAttribute* nameRef = item.element->findAttribute(name_referent);
+		if (nameRef)
+			binder.announceID(nameRef, instance);
+
+		for (size_t i = 0; i < item.properties.size(); ++i)
+		{
+			const StagedProperty& property = item.properties[i];
+			const float* v = property.floatValues;
+
+			switch (property.type)
+			{
+			case STAGED_BOOL:
+				setStaged(*property.desc, instance, property.boolValue);
+				break;
+			case STAGED_INT:
+				setStaged(*property.desc, instance, property.intValue);
+				break;
+			case STAGED_FLOAT:
+				setStaged(*property.desc, instance, v[0]);
+				break;
+			case STAGED_VECTOR3:
+				setStaged(*property.desc, instance, G3D::Vector3(v[0], v[1], v[2]));
+				break;
+			case STAGED_COLOR3:
+				setStaged(*property.desc, instance, G3D::Color3(v[0], v[1], v[2]));
+				break;
+			case STAGED_CFRAME:
+				setStaged(*property.desc, instance, G3D::CoordinateFrame(G3D::Matrix3(v[3], v[4], v[5], v[6], v[7], v[8], v[9], v[10], v[11]), G3D::Vector3(v[0], v[1], v[2])));
+				break;
+			default:
+				instance->readProperty(property.element, binder);
+				break;
+			}
+		}
+
+		instance->children.reserve(instance->numChildren() + item.children.size());
+
+		for (size_t i = 0; i < item.children.size(); ++i)
+		{
+			size_t child = item.children[i];
+			apply(child);
+
+			if (items[child].instance)
+				items[child].instance->setParent(instance);
+		}
+	}
+}
+
+void SerializerV2::loadInstancesParallel(const XmlElement* root, std::vector<boost::shared_ptr<RBX::Instance>>& result)
+{
+	ArchiveBinder binder;
+	RBX::XmlParallelReader reader(NULL, binder);
+
+	reader.read(root);
+
+	binder.resolveRefs();
+	result.insert(result.end(), reader.getInstances().begin(), reader.getInstances().end());
+}
+
+void SerializerV2::loadInstances(std::istream& stream, std::vector<boost::shared_ptr<RBX::Instance>>& result)
+{
+	ArchiveBinder binder;
+	RBX::XmlInstanceReader reader(NULL, binder);
+
+	TextXmlParser parser(stream.rdbuf());
+	parser.parse(reader);
+
+	binder.resolveRefs();
+	result.insert(result.end(), reader.getInstances().begin(), reader.getInstances().end());
+}
+
 bool ArchiveBinder::resolveRefs()
 {
 	size_t counts = std::count_if(idrefBindings.begin(), idrefBindings.end(), boost::bind(&ArchiveBinder::resolveIDREF, this, _1));
@@ -1,9 +1,12 @@
 #include "v8xml/XmlSerializer.h"
 #include "util/Debug.h"
-#include "util/base64.hpp"
+#include "util/Base64.h"
+#include "util/ContentProvider.h"
 #include "reflection/type.h"
 #include <G3D/format.h>
+#include <boost/scoped_ptr.hpp>
 #include <sstream>
+#include <stack>
 
 class Whitespaces
 {
@@ -158,6 +161,38 @@ std::string TextXmlParser::readText(bool decode)
 	return text;
 }
 
+// Decodes the base64 text up to the next tag straight off the buffer, hashing it on the way
+boost::shared_ptr<const std::string> TextXmlParser::readBinary(std::string& hash)
+{
+	boost::scoped_ptr<RBX::MD5Hasher> hasher(RBX::MD5Hasher::create());
+
+	std::string* data = new std::string();
+	boost::shared_ptr<const std::string> result(data);
+	RBX::Base64Decoder decoder(*data, hasher.get());
+
+	char text[4096];
+	size_t size = 0;
+	for (int c = buffer->sgetc(); c != '<'; c = buffer->snextc())
+	{
+		if (c == std::char_traits<char>::eof())
+			throw std::runtime_error("unexpected end of binary content");
+
+		text[size++] = (char)c;
+		if (size == sizeof(text))
+		{
+			decoder.decode(text, size);
+			size = 0;
+		}
+	}
+
+	decoder.decode(text, size);
+	if (!decoder.finish())
+		throw std::runtime_error("binary content is not valid base64");
+
+	hash = hasher->toString();
+	return result;
+}
+
 std::string TextXmlParser::removeTag(const std::string& contents, int& index)
 {
 	size_t i = 0;
@@ -254,11 +289,71 @@ bool endsWithClose(const std::string& test)
 	return false;
 }
 
-std::auto_ptr<XmlElement> TextXmlParser::parse()
+void TextXmlParser::readValue(XmlElement* newElement)
+{
+	if (newElement->getTag() == RBX::Reflection::Type::singleton<RBX::ContentId>().tag)
+	{
+		bool isXsiNil;
+		const XmlAttribute* xsiNilAttribute = newElement->findAttribute(name_xsinil);
+		if (xsiNilAttribute && xsiNilAttribute->getValue(isXsiNil) && !isXsiNil)
+		{
+			if (readText(false) == "")
+			{
+				const RBX::Name* mimeType;
+				const XmlAttribute* mimeTypeAttribute = newElement->findAttribute(tag_mimeType);
+				if (mimeTypeAttribute)
+					mimeTypeAttribute->getValue(mimeType);
+				else
+					mimeType = &RBX::Name::getNullName();
+
+				std::string contentChild = readTag();
+				std::string tagName = contentChild.substr(1, contentChild.size() - 2);
+
+				if (tagName.substr(0, 6) == "binary")
+				{
+					std::string hash;
+					boost::shared_ptr<const std::string> decoded = readBinary(hash);
+
+					RBX::ContentId contentId = RBX::ContentProvider::singleton().registerContent(decoded, hash, *mimeType);
+					newElement->setValue(contentId);
+				}
+				else if (tag_hash == tagName)
+				{
+					std::string name = readText(false);
+					newElement->setValue(RBX::ContentId(name.c_str(), *mimeType));
+				}
+				else if (tagName.substr(0, 3) == "url")
+				{
+					std::string url = readText(true);
+					newElement->setValue(RBX::ContentId(url.c_str(), *mimeType));
+				}
+				else if (tag_null == tagName)
+				{
+					newElement->setValue(RBX::ContentId());
+				}
+				else
+				{
+					throw std::runtime_error(G3D::format("TextXmlParser::parse - Unknown tag '%s'.", tagName.substr(0, 32).c_str()));
+				}
+
+				std::string closingTag = readTag();
+				if (!isCloseTag(closingTag))
+					throw std::runtime_error(G3D::format("TextXmlParser::parse - '%s' should be a closing tag", tagName.substr(0, 32).c_str()));
+			}
+		}
+	}
+	else
+	{
+		newElement->setValue(readText(true));
+	}
+}
+
+void TextXmlParser::parse(XmlContentHandler& handler)
 {
 	if (buffer->sgetc() == -1)
 		throw std::runtime_error("TextXmlParser::parse empty file");
 
+	int depth = 0;
 	bool firstTag = true;
 	while (true)
 	{
@@ -275,93 +370,70 @@ std::auto_ptr<XmlElement> TextXmlParser::parse()
 			currentTag = readTag();
 		}
 
-		XmlElement* currentElement = elements.empty() ? NULL : elements.top();
 		if (isCloseTag(currentTag))
 		{
-			if (!currentElement)
+			if (depth == 0)
 				throw std::runtime_error(G3D::format("TextXmlParser::parse - Got close tag %s without open tag.", currentTag.c_str()));
 
-			elements.pop();
-			if (elements.empty())
-				return std::auto_ptr<XmlElement>(currentElement);
+			handler.endElement();
+			if (--depth == 0)
+				return;
 		}
 		else
 		{
-			XmlElement* newElement = parseAttributes(currentTag);
-			elements.push(newElement);
+			std::auto_ptr<XmlElement> newElement(parseAttributes(currentTag));
+			readValue(newElement.get());
+
+			handler.startElement(newElement.release());
 
-			if (newElement->getTag() == RBX::Reflection::Type::singleton<RBX::ContentId>().tag)
+			if (endsWithClose(currentTag))
 			{
-				bool isXsiNil;
-				const XmlAttribute* xsiNilAttribute = newElement->findAttribute(name_xsinil);
-				if (xsiNilAttribute && xsiNilAttribute->getValue(isXsiNil) && !isXsiNil)
-				{
-					if (readText(false) == "")
-					{
-						const RBX::Name* mimeType;
-						const XmlAttribute* mimeTypeAttribute = newElement->findAttribute(tag_mimeType);
-						if (mimeTypeAttribute)
-							mimeTypeAttribute->getValue(mimeType);
-						else
-							mimeType = &RBX::Name::getNullName();
-
-						std::string contentChild = readTag();
-						std::string tagName = contentChild.substr(1, contentChild.size() - 2);
-
-						if (tagName.substr(0, 6) == "binary")
-						{
-							std::stringbuf encoded(readText(false), std::ios_base::in);
-							std::stringstream decoded;
-
-							int ioStatus = 0;
-							base64<char> decoder;
-							decoder.get(
-								std::istreambuf_iterator<char>(&encoded),
-								std::istreambuf_iterator<char>(),
-								std::ostreambuf_iterator<char>(decoded),
-								ioStatus);
-
-							decoded.flush();
-
-							RBX::ContentId contentId = RBX::ContentProvider::singleton().registerContent(decoded, *mimeType);
-							newElement->setValue(contentId);
-						}
-						else if (tag_hash == tagName)
-						{
-							std::string name = readText(false);
-							newElement->setValue(RBX::ContentId(name.c_str(), *mimeType));
-						}
-						else if (tagName.substr(0, 3) == "url")
-						{
-							std::string url = readText(true);
-							newElement->setValue(RBX::ContentId(url.c_str(), *mimeType));
-						}
-						else if (tag_null == tagName)
-						{
-							newElement->setValue(RBX::ContentId());
-						}
-						else
-						{
-							throw std::runtime_error(G3D::format("TextXmlParser::parse - Unknown tag '%s'.", tagName.substr(0, 32).c_str()));
-						}
-
-						std::string closingTag = readTag();
-						if (!isCloseTag(closingTag))
-							throw std::runtime_error(G3D::format("TextXmlParser::parse - '%s' should be a closing tag", tagName.substr(0, 32).c_str()));
-					}
-				}
+				handler.endElement();
+				if (depth == 0)
+					return;
 			}
 			else
 			{
-				newElement->setValue(readText(true));
+				++depth;
 			}
+		}
+	}
+}
 
-			currentElement->pushBackChild(newElement);
+// Builds the whole document as an XmlElement tree
+class XmlTreeBuilder : public XmlContentHandler
+{
+private:
+	std::auto_ptr<XmlElement> root;
+	std::stack<XmlElement*> elements;
 
-			if (endsWithClose(currentTag))
-				elements.pop();
-		}
+public:
+	virtual void startElement(XmlElement* element)
+	{
+		if (elements.empty())
+			root.reset(element);
+		else
+			elements.top()->pushBackChild(element);
+
+		elements.push(element);
 	}
+
+	virtual void endElement()
+	{
+		elements.pop();
+	}
+
+	std::auto_ptr<XmlElement> release()
+	{
+		return root;
+	}
+};
+
+std::auto_ptr<XmlElement> TextXmlParser::parse()
+{
+	XmlTreeBuilder builder;
+	parse(builder);
+	return builder.release();
 }
 
 int XmlWriter::getHandleIndex(RBX::InstanceHandle h)
@@ -560,7 +632,7 @@ void TextXmlWriterWithEmbeddedContent::serializeNode(const XmlElement* xmlNode,
 				else if (embeddedContent.find(contentId) == embeddedContent.end())
 				{
 					embeddedContent.insert(contentId);
-					std::auto_ptr<std::istream> contentStream = RBX::ContentProvider::singleton().getContent(contentId);
+					boost::shared_ptr<const std::string> content = RBX::ContentProvider::singleton().getContentString(contentId);
 					if (contentId.mimeType() == RBX::Name::getNullName())
 					{
 						stream << "<binary>";
@@ -570,14 +642,8 @@ void TextXmlWriterWithEmbeddedContent::serializeNode(const XmlElement* xmlNode,
 						stream << "<binary xmime:contentType=\"" << contentId.mimeType().name << "\">";
 					}
 
-					int ioStatus = 0;
-					base64<char> encoder;
-					encoder.put(
-						std::istreambuf_iterator<char>(*contentStream.get()),
-						std::istreambuf_iterator<char>(),
-						std::ostreambuf_iterator<char>(stream),
-						ioStatus,
-						base64<>::crlf());
+					if (content)
+						RBX::base64Encode(content->data(), content->size(), stream);
 
 					stream << "</binary>";
 				}
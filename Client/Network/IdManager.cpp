@@ -5,6 +5,12 @@
 
 namespace RBX
 {
+	Instance* IdManager::getInstance(Guid::Data id)
+	{
+		Instance** item = items.find(id);
+		return item ? *item : NULL;
+	}
+
 	void IdManager::addInstance(Instance* instance, Guid::Data explicitId)
 	{
 		RBXASSERT(getInstance(explicitId) == NULL);
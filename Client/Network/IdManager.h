@@ -2,9 +2,9 @@
 #include "v8tree/Instance.h"
 #include "v8tree/Service.h"
 #include "util/Guid.h"
+#include "util/GuidMap.h"
 #include <boost/shared_ptr.hpp>
 #include <boost/signals/connection.hpp>
-#include <map>
 
 namespace RBX
 {
@@ -13,7 +13,7 @@ namespace RBX
 	class IdManager : public DescribedNonCreatable<IdManager, Instance, &sIdManager>, public Service
 	{
 	private:
-		std::map<Guid::Data, Instance*> items;
+		GuidMap<Instance*> items;
 		boost::signals::scoped_connection removeInstanceConnection;
 	public:
 		Instance* getInstance(Guid::Data id);
@@ -247,11 +247,15 @@ namespace RBX
 
 		void IdSerializer::resolvePendingBindings(Instance* instance, Guid::Data id)
 		{
-			std::map<Guid::Data, std::vector<WaitItem>>::iterator iter = waitItems.find(id);
-			if (iter != waitItems.end())
+			std::vector<WaitItem>* found = waitItems.find(id);
+			if (found)
 			{
-				std::for_each(iter->second.begin(), iter->second.end(), boost::bind(&IdSerializer::setRefValue, _1, instance));
-				waitItems.erase(iter);
+				// taken out of the map first: setRefValue can add to it and move its slots
+				std::vector<WaitItem> items;
+				items.swap(*found);
+				waitItems.erase(id);
+
+				std::for_each(items.begin(), items.end(), boost::bind(&IdSerializer::setRefValue, _1, instance));
 			}
 		}
 
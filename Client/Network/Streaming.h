@@ -3,6 +3,7 @@
 #include "util/ContentProvider.h"
 #include "util/Name.h"
 #include "util/Guid.h"
+#include "util/GuidMap.h"
 #include "reflection/property.h"
 #include <BitStream.h>
 #include <g3d/CoordinateFrame.h>
@@ -109,7 +110,7 @@ namespace RBX
 		private:
 			SharedStringDictionary scopeNames;
 		protected:
-			std::map<Guid::Data, std::vector<WaitItem>> waitItems;
+			GuidMap<std::vector<WaitItem>> waitItems;
 		public:
 			//IdSerializer(const IdSerializer&);
 			IdSerializer() {}
@@ -1,11 +1,16 @@
 #include "RenderLib/AggregatingSceneManager.h"
+#include "Clusterer.h"
+#include <G3D/System.h>
 
 namespace RBX
 {
 	namespace Render
 	{
+		size_t AggregatingSceneManager::aggregationSize = 32;
+
 		AggregatingSceneManager::AggregatingSceneManager(RenderScene* renderScene)
-			: SceneManager(renderScene)
+			: SceneManager(renderScene),
+			  nextBucket(0)
 		{
 		}
 
@@ -18,8 +23,8 @@ namespace RBX
 
 		void AggregatingSceneManager::removeModel(const G3D::ReferenceCountedPointer<Chunk>& chunk)
 		{
-			invalidSleepingModels.erase(chunk);
-			invalidMovingModels.erase(chunk);
+			invalidSleepingModels.erase(chunk.pointer());
+			invalidMovingModels.erase(chunk.pointer());
 
 			G3D::ReferenceCountedPointer<AggregateChunk> aggregate = chunk->aggregate.createStrongPtr();
 			if (aggregate.notNull())
@@ -33,19 +38,19 @@ namespace RBX
 		{
 			if (sleeping)
 			{
-				bool erased = invalidMovingModels.erase(chunk) == 1;
+				bool erased = invalidMovingModels.erase(chunk.pointer()) == 1;
 
 				if (erased)
-					invalidSleepingModels.insert(chunk);
+					invalidSleepingModels[chunk.pointer()] = chunk;
 
 				queueSleepingChunk(chunk);
 			}
 			else
 			{
-				bool erased = invalidSleepingModels.erase(chunk) == 1;
+				bool erased = invalidSleepingModels.erase(chunk.pointer()) == 1;
 
 				if (erased)
-					invalidMovingModels.insert(chunk);
+					invalidMovingModels[chunk.pointer()] = chunk;
 
 				G3D::ReferenceCountedPointer<AggregateChunk> aggregate = chunk->aggregate.createStrongPtr();
 				if (aggregate.notNull())
@@ -53,72 +58,229 @@ namespace RBX
 
 				dequeueSleepingChunk(chunk);
 			}
+
+			setSleepingInScene(chunk, sleeping);
 		}
 
 		void AggregatingSceneManager::invalidateModel(const G3D::ReferenceCountedPointer<Chunk>& chunk, bool isSleeping)
 		{
+			invalidateInScene(chunk);
+
 			if (isSleeping)
-				invalidSleepingModels.insert(chunk);
+				invalidSleepingModels[chunk.pointer()] = chunk;
 			else
-				invalidMovingModels.insert(chunk);
+				invalidMovingModels[chunk.pointer()] = chunk;
 		}
 
 		void AggregatingSceneManager::dequeueSleepingChunk(const G3D::ReferenceCountedPointer<Chunk>& chunk)
 		{
-			std::map<BucketKey, G3D::ReferenceCountedPointer<Bucket>>::iterator iter = buckets.begin();
-			std::map<BucketKey, G3D::ReferenceCountedPointer<Bucket>>::iterator end = buckets.end();
+			Bucket* bucket = static_cast<Bucket*>(chunk->sleepingBucket);
+			if (bucket)
+				bucket->dequeueSleepingChunk(chunk);
+		}
+
+		void AggregatingSceneManager::clear()
+		{
+			invalidSleepingModels.clear();
+			invalidMovingModels.clear();
+
+			for (size_t i = 0; i < bucketList.size(); i++)
+			{
+				bucketList[i]->clear();
+			}
+
+			clearScene();
+		}
+
+		void AggregatingSceneManager::prerender(double maxTime)
+		{
+			double deadline = G3D::System::getTick() + maxTime;
+
+			// a sleeping chunk that changed leaves its aggregate out of date, and may belong in another bucket
+			InvalidModels::iterator iter = invalidSleepingModels.begin();
+			InvalidModels::iterator end = invalidSleepingModels.end();
 
 			for (; iter != end; iter++)
 			{
-				if (iter->second->dequeueSleepingChunk(chunk))
+				const G3D::ReferenceCountedPointer<Chunk>& chunk = iter->second;
+
+				G3D::ReferenceCountedPointer<AggregateChunk> aggregate = chunk->aggregate.createStrongPtr();
+				if (aggregate.notNull())
+					deconstructAggregate(aggregate);
+
+				dequeueSleepingChunk(chunk);
+				queueSleepingChunk(chunk);
+			}
+
+			invalidSleepingModels.clear();
+
+			// buckets take turns, so a big one can't keep the others waiting
+			for (size_t visited = 0; visited < bucketList.size(); visited++)
+			{
+				if (G3D::System::getTick() >= deadline)
 					break;
+
+				nextBucket %= bucketList.size();
+				bucketList[nextBucket++]->optimize(*this, deadline);
 			}
 		}
 
-		void AggregatingSceneManager::clear()
+		void AggregatingSceneManager::constructAggregate(const std::vector<G3D::ReferenceCountedPointer<Chunk>>& components)
 		{
-			invalidSleepingModels.clear();
-			invalidMovingModels.clear();
+			G3D::ReferenceCountedPointer<AggregateChunk> aggregate = new AggregateChunk(components[0]);
 
-			std::map<BucketKey, G3D::ReferenceCountedPointer<Bucket>>::iterator iter = buckets.begin();
-			std::map<BucketKey, G3D::ReferenceCountedPointer<Bucket>>::iterator end = buckets.end();
+			for (size_t i = 0; i < components.size(); i++)
+			{
+				const G3D::ReferenceCountedPointer<Chunk>& component = components[i];
 
-			for (; iter != end; iter++)
+				dequeueSleepingChunk(component);
+				removeFromScene(component);
+				component->aggregate = aggregate;
+			}
+
+			aggregate->components = components;
+			RenderStats::aggregatedChunkCount += (int)components.size();
+
+			aggregate->makeMesh();
+
+			addToScene(aggregate);
+			setSleepingInScene(aggregate, true);
+		}
+
+		// The components go back into the scene and their queues, still asleep. A caller waking
+		// or removing one of them takes it out again
+		void AggregatingSceneManager::deconstructAggregate(G3D::ReferenceCountedPointer<AggregateChunk> aggregate)
+		{
+			removeFromScene(aggregate);
+
+			for (size_t i = 0; i < aggregate->components.size(); i++)
 			{
-				iter->second->clear();
+				const G3D::ReferenceCountedPointer<Chunk>& component = aggregate->components[i];
+
+				component->aggregate = G3D::WeakReferenceCountedPointer<AggregateChunk>();
+				addToScene(component);
+				setSleepingInScene(component, true);
+				queueSleepingChunk(component);
 			}
+		}
 
-			clearScene();
+		AggregatingSceneManager::Bucket::Bucket()
+			: nextCluster(0),
+			  queuedSinceClustering(0)
+		{
+		}
+
+		AggregatingSceneManager::Bucket::~Bucket()
+		{
+			clear();
+		}
+
+		void AggregatingSceneManager::Bucket::clear()
+		{
+			for (size_t i = 0; i < queue.size(); i++)
+			{
+				queue[i]->sleepingBucket = NULL;
+			}
+
+			queue.clear();
+			clusterer.reset();
+			nextCluster = 0;
+			queuedSinceClustering = 0;
+		}
+
+		void AggregatingSceneManager::Bucket::addToQueue(const G3D::ReferenceCountedPointer<Chunk>& chunk)
+		{
+			chunk->sleepingBucket = this;
+			chunk->sleepingIndex = queue.size();
+			queue.push_back(chunk);
+
+			queuedSinceClustering++;
+
+			if (clusterer.get())
+				clusterer->addSample(chunk.pointer());
 		}
 
 		bool AggregatingSceneManager::Bucket::dequeueSleepingChunk(const G3D::ReferenceCountedPointer<Chunk>& chunk)
 		{
-			std::vector<G3D::ReferenceCountedPointer<Chunk>>::iterator found = std::find(queue.begin(), queue.end(), chunk);
+			if (chunk->sleepingBucket != this)
+				return false;
+
+			size_t index = chunk->sleepingIndex;
+			debugAssert(queue[index] == chunk);
+
+			if (clusterer.get())
+				clusterer->removeSample(chunk.pointer());
+
+			// the last chunk takes its place
+			queue[index] = queue.back();
+			queue[index]->sleepingIndex = index;
+			queue.pop_back();
 
-			if (found != queue.end())
+			chunk->sleepingBucket = NULL;
+			return true;
+		}
+
+		// The work goes in steps - seeding, a clustering pass, one aggregate - with the deadline
+		// checked between them, so a frame overruns it by one step at most
+		void AggregatingSceneManager::Bucket::optimize(AggregatingSceneManager& manager, double deadline)
+		{
+			if (!clusterer.get())
 			{
-				queue.erase(found);
-				return true;
+				// chunks left over from the last clustering don't start another one by themselves
+				if (queue.size() < aggregationSize || queuedSinceClustering == 0)
+					return;
+
+				clusterer.reset(new Clusterer(queue.size() / aggregationSize));
+				clusterer->addSamples(queue.begin(), queue.end());
+				nextCluster = 0;
+				queuedSinceClustering = 0;
 			}
-			else
+
+			// settled clusters being handed out over several frames aren't run again, unless
+			// chunks queued in the meantime unsettle them
+			while (!clusterer->settled())
 			{
-				return false;
+				if (G3D::System::getTick() >= deadline)
+					return;
+
+				clusterer->go(1);
 			}
+
+			std::vector<Clusterer::Cluster>& clusters = clusterer->getClusters();
+			while (nextCluster < clusters.size())
+			{
+				if (G3D::System::getTick() >= deadline)
+					return;
+
+				const Clusterer::Cluster& cluster = clusters[nextCluster++];
+				if (cluster.samples.size() < 2)
+					continue;
+
+				// copied, since the components leave the clusterer as they leave the queue
+				std::vector<G3D::ReferenceCountedPointer<Chunk>> components(cluster.samples.begin(), cluster.samples.end());
+				manager.constructAggregate(components);
+			}
+
+			clusterer.reset();
 		}
 
 		void AggregatingSceneManager::queueSleepingChunk(const G3D::ReferenceCountedPointer<Chunk>& chunk)
 		{
+			if (chunk->sleepingBucket || chunk->aggregate.createStrongPtr().notNull())
+				return;
+
 			G3D::ReferenceCountedPointer<Bucket> queue;
 
 			{
 				BucketKey key(chunk);
 
-				std::map<BucketKey, G3D::ReferenceCountedPointer<Bucket>>::iterator iter = buckets.find(key);
+				stdext::hash_map<BucketKey, G3D::ReferenceCountedPointer<Bucket>, BucketKeyHasher>::iterator iter = buckets.find(key);
 
 				if (iter == buckets.end())
 				{
 					queue = new Bucket;
 					buckets[key] = queue;
+					bucketList.push_back(queue);
 				}
 				else
 				{
@@ -129,6 +291,21 @@ namespace RBX
 			queue->addToQueue(chunk);
 		}
 
+		size_t AggregatingSceneManager::BucketKeyHasher::operator()(const AggregatingSceneManager::BucketKey& key) const
+		{
+			union
+			{
+				float f;
+				unsigned int i;
+			} offset;
+			offset.f = key.polygonOffset;
+
+			size_t hash = reinterpret_cast<size_t>(key.material.pointer()) >> 4;
+			hash = hash * 31 + offset.i;
+			hash = hash * 31 + (key.castsShadows ? 2 : 0) + (key.cullable ? 1 : 0);
+			return hash;
+		}
+
 		bool AggregatingSceneManager::BucketKey::operator<(const AggregatingSceneManager::BucketKey& that) const
 		{
 			if (this->material < that.material)
@@ -8,6 +8,7 @@ namespace RBX
 		const float Chunk::TEXTURE_OFFSET = -0.1f;
 
 		const G3D::CoordinateFrame AggregateChunk::identity;
+		bool AggregateChunk::randomColors = false;
 
 		AggregateChunk::AggregateChunk(const G3D::ReferenceCountedPointer<Chunk>& firstChunk)
 			: Chunk(firstChunk->polygonOffset),
@@ -0,0 +1,491 @@
+#include "RenderLib/ChunkHierarchy.h"
+
+namespace RBX
+{
+	namespace Render
+	{
+		// leaf boxes are grown by this much of the chunk's radius, plus a little
+		static const float fatRadiusScale = 0.25f;
+		static const float fatMargin = 0.5f;
+
+		static float halfArea(const G3D::Vector3& low, const G3D::Vector3& high)
+		{
+			G3D::Vector3 size = high - low;
+			return size.x * size.y + size.y * size.z + size.z * size.x;
+		}
+
+		static G3D::Vector3 minVector(const G3D::Vector3& a, const G3D::Vector3& b)
+		{
+			return G3D::Vector3(G3D::min(a.x, b.x), G3D::min(a.y, b.y), G3D::min(a.z, b.z));
+		}
+
+		static G3D::Vector3 maxVector(const G3D::Vector3& a, const G3D::Vector3& b)
+		{
+			return G3D::Vector3(G3D::max(a.x, b.x), G3D::max(a.y, b.y), G3D::max(a.z, b.z));
+		}
+
+		ChunkHierarchy::ChunkHierarchy()
+			: root(-1),
+			  rankCount(0)
+		{
+		}
+
+		int ChunkHierarchy::allocateNode()
+		{
+			int node;
+			if (freeNodes.size() > 0)
+			{
+				node = freeNodes.pop();
+			}
+			else
+			{
+				node = nodes.size();
+				nodes.next();
+			}
+
+			Node& n = nodes[node];
+			n.parent = -1;
+			n.left = -1;
+			n.right = -1;
+			n.chunk = NULL;
+			n.inTree = false;
+			n.sleeping = false;
+			n.awakeIndex = -1;
+			n.drawRank = -1;
+			n.culledIndex = -1;
+			return node;
+		}
+
+		void ChunkHierarchy::freeNode(int node)
+		{
+			nodes[node].chunk = NULL;
+			freeNodes.append(node);
+		}
+
+		bool ChunkHierarchy::bounds(Chunk* chunk, G3D::Vector3& low, G3D::Vector3& high) const
+		{
+			if (!chunk->cullable() || !G3D::isFinite(chunk->radius))
+				return false;
+
+			const G3D::Vector3& center = chunk->cframe().translation;
+			G3D::Vector3 extent(chunk->radius, chunk->radius, chunk->radius);
+			low = center - extent;
+			high = center + extent;
+			return true;
+		}
+
+		void ChunkHierarchy::insert(const G3D::ReferenceCountedPointer<Chunk>& chunk)
+		{
+			if (leaves.find(chunk.pointer()) != leaves.end())
+				return;
+
+			int leaf = allocateNode();
+			nodes[leaf].chunk = chunk;
+			leaves[chunk.pointer()] = leaf;
+
+			nodes[leaf].awakeIndex = awakeLeaves.size();
+			awakeLeaves.append(leaf);
+
+			place(leaf);
+		}
+
+		// into the tree with a fattened box, or onto the unbounded list
+		void ChunkHierarchy::place(int leaf)
+		{
+			Node& n = nodes[leaf];
+
+			G3D::Vector3 low, high;
+			if (bounds(n.chunk.pointer(), low, high))
+			{
+				G3D::Vector3 margin = G3D::Vector3(1, 1, 1) * (n.chunk->radius * fatRadiusScale + fatMargin);
+				n.low = low - margin;
+				n.high = high + margin;
+				insertLeaf(leaf);
+			}
+			else
+			{
+				unboundedLeaves.append(leaf);
+			}
+		}
+
+		void ChunkHierarchy::remove(const G3D::ReferenceCountedPointer<Chunk>& chunk)
+		{
+			std::map<const Chunk*, int>::iterator iter = leaves.find(chunk.pointer());
+			if (iter == leaves.end())
+				return;
+
+			int leaf = iter->second;
+			leaves.erase(iter);
+
+			Node& n = nodes[leaf];
+			if (n.inTree)
+				removeLeaf(leaf);
+			else
+				unboundedLeaves.fastRemove(unboundedLeaves.findIndex(leaf));
+
+			if (n.awakeIndex >= 0)
+			{
+				int last = awakeLeaves.last();
+				awakeLeaves[n.awakeIndex] = last;
+				nodes[last].awakeIndex = n.awakeIndex;
+				awakeLeaves.pop();
+			}
+
+			int invalid = invalidLeaves.findIndex(leaf);
+			if (invalid >= 0)
+				invalidLeaves.fastRemove(invalid);
+
+			// the draw order refers to the last cull by position, so leave a gap rather than shift it
+			if (n.culledIndex >= 0 && n.culledIndex < culled.size() && culled[n.culledIndex] == leaf)
+				culled[n.culledIndex] = -1;
+
+			freeNode(leaf);
+		}
+
+		void ChunkHierarchy::clear()
+		{
+			nodes.clear();
+			freeNodes.clear();
+			root = -1;
+			leaves.clear();
+			awakeLeaves.clear();
+			invalidLeaves.clear();
+			unboundedLeaves.clear();
+			culled.clear();
+			rankCount = 0;
+		}
+
+		void ChunkHierarchy::setSleeping(const G3D::ReferenceCountedPointer<Chunk>& chunk, bool sleeping)
+		{
+			std::map<const Chunk*, int>::iterator iter = leaves.find(chunk.pointer());
+			if (iter == leaves.end())
+				return;
+
+			int leaf = iter->second;
+			if (nodes[leaf].sleeping == sleeping)
+				return;
+
+			if (sleeping)
+			{
+				// one last look, in case it moved since the last update
+				updateLeaf(leaf);
+			}
+
+			Node& n = nodes[leaf];
+			n.sleeping = sleeping;
+			if (sleeping)
+			{
+
+				int last = awakeLeaves.last();
+				awakeLeaves[n.awakeIndex] = last;
+				nodes[last].awakeIndex = n.awakeIndex;
+				awakeLeaves.pop();
+				n.awakeIndex = -1;
+			}
+			else
+			{
+				n.awakeIndex = awakeLeaves.size();
+				awakeLeaves.append(leaf);
+			}
+		}
+
+		void ChunkHierarchy::invalidate(const G3D::ReferenceCountedPointer<Chunk>& chunk)
+		{
+			std::map<const Chunk*, int>::iterator iter = leaves.find(chunk.pointer());
+			if (iter != leaves.end() && nodes[iter->second].sleeping && !invalidLeaves.contains(iter->second))
+				invalidLeaves.append(iter->second);
+		}
+
+		void ChunkHierarchy::update()
+		{
+			for (int i = 0; i < awakeLeaves.size(); i++)
+				updateLeaf(awakeLeaves[i]);
+
+			for (int i = 0; i < invalidLeaves.size(); i++)
+				updateLeaf(invalidLeaves[i]);
+
+			invalidLeaves.fastClear();
+		}
+
+		void ChunkHierarchy::updateLeaf(int leaf)
+		{
+			Node& n = nodes[leaf];
+
+			G3D::Vector3 low, high;
+			bool bounded = bounds(n.chunk.pointer(), low, high);
+
+			if (bounded && n.inTree)
+			{
+				if (low.x >= n.low.x && low.y >= n.low.y && low.z >= n.low.z &&
+					high.x <= n.high.x && high.y <= n.high.y && high.z <= n.high.z)
+				{
+					return;
+				}
+
+				removeLeaf(leaf);
+			}
+			else if (!bounded && !n.inTree)
+			{
+				return;
+			}
+			else if (!n.inTree)
+			{
+				unboundedLeaves.fastRemove(unboundedLeaves.findIndex(leaf));
+			}
+			else
+			{
+				removeLeaf(leaf);
+			}
+
+			place(leaf);
+		}
+
+		// Walks down to the sibling that adds the least surface area, the way dynamic AABB trees do
+		void ChunkHierarchy::insertLeaf(int leaf)
+		{
+			nodes[leaf].inTree = true;
+
+			if (root < 0)
+			{
+				root = leaf;
+				nodes[leaf].parent = -1;
+				return;
+			}
+
+			G3D::Vector3 leafLow = nodes[leaf].low;
+			G3D::Vector3 leafHigh = nodes[leaf].high;
+
+			int index = root;
+			while (nodes[index].left >= 0)
+			{
+				const Node& n = nodes[index];
+
+				float area = halfArea(n.low, n.high);
+				float combinedArea = halfArea(minVector(n.low, leafLow), maxVector(n.high, leafHigh));
+
+				float cost = 2.0f * combinedArea;
+				float inheritance = 2.0f * (combinedArea - area);
+
+				float childCost[2];
+				int children[2] = { n.left, n.right };
+				for (int c = 0; c < 2; c++)
+				{
+					const Node& child = nodes[children[c]];
+					float merged = halfArea(minVector(child.low, leafLow), maxVector(child.high, leafHigh));
+					childCost[c] = (child.left < 0 ? merged : merged - halfArea(child.low, child.high)) + inheritance;
+				}
+
+				if (cost < childCost[0] && cost < childCost[1])
+					break;
+
+				index = childCost[0] < childCost[1] ? n.left : n.right;
+			}
+
+			int sibling = index;
+			int oldParent = nodes[sibling].parent;
+
+			int newParent = allocateNode();
+			Node& p = nodes[newParent];
+			p.parent = oldParent;
+			p.left = sibling;
+			p.right = leaf;
+			p.inTree = true;
+
+			if (oldParent >= 0)
+			{
+				if (nodes[oldParent].left == sibling)
+					nodes[oldParent].left = newParent;
+				else
+					nodes[oldParent].right = newParent;
+			}
+			else
+			{
+				root = newParent;
+			}
+
+			nodes[sibling].parent = newParent;
+			nodes[leaf].parent = newParent;
+
+			refit(newParent);
+		}
+
+		void ChunkHierarchy::removeLeaf(int leaf)
+		{
+			nodes[leaf].inTree = false;
+
+			if (leaf == root)
+			{
+				root = -1;
+				return;
+			}
+
+			int parent = nodes[leaf].parent;
+			int grandParent = nodes[parent].parent;
+			int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+			if (grandParent >= 0)
+			{
+				if (nodes[grandParent].left == parent)
+					nodes[grandParent].left = sibling;
+				else
+					nodes[grandParent].right = sibling;
+
+				nodes[sibling].parent = grandParent;
+				refit(grandParent);
+			}
+			else
+			{
+				root = sibling;
+				nodes[sibling].parent = -1;
+			}
+
+			freeNode(parent);
+			nodes[leaf].parent = -1;
+		}
+
+		void ChunkHierarchy::refit(int node)
+		{
+			while (node >= 0)
+			{
+				Node& n = nodes[node];
+				n.low = minVector(nodes[n.left].low, nodes[n.right].low);
+				n.high = maxVector(nodes[n.left].high, nodes[n.right].high);
+				node = n.parent;
+			}
+		}
+
+		// Each node carries on only the planes its parent wasn't already completely inside
+		void ChunkHierarchy::query(const G3D::Array<G3D::Plane>& planes, G3D::Array<int>& result)
+		{
+			result.fastClear();
+
+			for (int i = 0; i < unboundedLeaves.size(); i++)
+				result.append(unboundedLeaves[i]);
+
+			if (root < 0)
+				return;
+
+			debugAssert(planes.size() <= 31);
+			int allPlanes = (1 << planes.size()) - 1;
+
+			stack.fastClear();
+			stack.append(root);
+			stack.append(allPlanes);
+
+			while (stack.size() > 0)
+			{
+				int mask = stack.pop();
+				int node = stack.pop();
+				const Node& n = nodes[node];
+
+				if (mask != 0)
+				{
+					G3D::Vector3 center = (n.low + n.high) * 0.5f;
+					G3D::Vector3 extent = (n.high - n.low) * 0.5f;
+
+					bool outside = false;
+					for (int p = 0; p < planes.size(); p++)
+					{
+						if (!(mask & (1 << p)))
+							continue;
+
+						const G3D::Vector3& normal = planes[p].normal();
+						float radius = fabs(normal.x) * extent.x + fabs(normal.y) * extent.y + fabs(normal.z) * extent.z;
+						float distance = planes[p].distance(center);
+
+						if (distance < -radius)
+						{
+							outside = true;
+							break;
+						}
+
+						if (distance >= radius)
+							mask &= ~(1 << p);
+					}
+
+					if (outside)
+						continue;
+				}
+
+				if (n.left < 0)
+				{
+					result.append(node);
+				}
+				else
+				{
+					stack.append(n.left);
+					stack.append(mask);
+					stack.append(n.right);
+					stack.append(mask);
+				}
+			}
+		}
+
+		void ChunkHierarchy::find(const G3D::Array<G3D::Plane>& planes, G3D::Array<Chunk*>& found)
+		{
+			query(planes, result);
+
+			found.fastClear();
+			for (int i = 0; i < result.size(); i++)
+				found.append(nodes[result[i]].chunk.pointer());
+		}
+
+		void ChunkHierarchy::cull(const G3D::Array<G3D::Plane>& planes, G3D::Array<Chunk*>& visible)
+		{
+			query(planes, result);
+
+			// ranked chunks go back into their slots, a counting sort. A rank that is out of date
+			// loses its slot and the chunk goes to the end with the new ones
+			rankSlots.resize(rankCount, false);
+			for (int i = 0; i < rankCount; i++)
+				rankSlots[i] = -1;
+
+			culled.fastClear();
+			for (int i = 0; i < result.size(); i++)
+			{
+				Node& n = nodes[result[i]];
+				if (n.drawRank >= 0 && n.drawRank < rankCount && rankSlots[n.drawRank] < 0)
+					rankSlots[n.drawRank] = result[i];
+				else
+					n.drawRank = -1;
+			}
+
+			for (int i = 0; i < rankCount; i++)
+			{
+				if (rankSlots[i] >= 0)
+					culled.append(rankSlots[i]);
+			}
+
+			for (int i = 0; i < result.size(); i++)
+			{
+				if (nodes[result[i]].drawRank < 0)
+					culled.append(result[i]);
+			}
+
+			visible.fastClear();
+			for (int i = 0; i < culled.size(); i++)
+			{
+				nodes[culled[i]].culledIndex = i;
+				visible.append(nodes[culled[i]].chunk.pointer());
+			}
+		}
+
+		void ChunkHierarchy::setDrawOrder(const G3D::Array<int>& order)
+		{
+			for (int i = 0; i < culled.size(); i++)
+			{
+				if (culled[i] >= 0)
+					nodes[culled[i]].drawRank = -1;
+			}
+
+			for (int i = 0; i < order.size(); i++)
+			{
+				int leaf = order[i] < culled.size() ? culled[order[i]] : -1;
+				if (leaf >= 0)
+					nodes[leaf].drawRank = i;
+			}
+
+			rankCount = order.size();
+		}
+	}
+}
@@ -4,100 +4,508 @@ namespace RBX
 {
 	namespace Render
 	{
+		Clusterer::Cluster::Cluster()
+			: centroid(0.0f, 0.0f, 0.0f),
+			  halfSeparation(0.0f)
+		{
+			sum[0] = sum[1] = sum[2] = 0.0;
+		}
+
+		// sums are kept in doubles; a float total over thousands of positions loses the centroid
+		void Clusterer::Cluster::computeCentroid()
+		{
+			if (samples.empty())
+				return;
+
+			double count = (double)samples.size();
+			centroid = G3D::Vector3((float)(sum[0] / count), (float)(sum[1] / count), (float)(sum[2] / count));
+		}
+
+		float Clusterer::Cluster::getDistanceFromCentroid(Chunk* sample)
+		{
+			return (sample->cframe().translation - centroid).magnitude();
+		}
+
+		int Clusterer::CentroidGrid::cell(const G3D::Vector3& position, int axis) const
+		{
+			return G3D::iClamp((int)((position[axis] - low[axis]) / cellSize), 0, size[axis] - 1);
+		}
+
+		// Cells are sized so there are about as many of them as centroids, and the centroids are
+		// sorted into them by counting
+		void Clusterer::CentroidGrid::build(const G3D::Vector3& low, const G3D::Vector3& high, const std::vector<Cluster>& clusters, size_t count)
+		{
+			this->low = low;
+
+			G3D::Vector3 extent = high - low;
+			extent = G3D::Vector3(G3D::max(extent.x, 1e-3f), G3D::max(extent.y, 1e-3f), G3D::max(extent.z, 1e-3f));
+
+			cellSize = G3D::max(extent.x, G3D::max(extent.y, extent.z));
+			for (;;)
+			{
+				for (int axis = 0; axis < 3; axis++)
+					size[axis] = G3D::iMax(1, (int)ceil(extent[axis] / cellSize));
+
+				if ((double)size[0] * size[1] * size[2] >= (double)count || cellSize < 1e-3f)
+					break;
+
+				cellSize *= 0.8f;
+			}
+
+			size_t cells = (size_t)size[0] * size[1] * size[2];
+			cellStart.assign(cells + 1, 0);
+			cellClusters.resize(count);
+
+			std::vector<size_t> clusterCell(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				const G3D::Vector3& centroid = clusters[i].centroid;
+				clusterCell[i] = ((size_t)cell(centroid, 2) * size[1] + cell(centroid, 1)) * size[0] + cell(centroid, 0);
+				cellStart[clusterCell[i] + 1]++;
+			}
+
+			for (size_t i = 0; i < cells; i++)
+				cellStart[i + 1] += cellStart[i];
+
+			std::vector<size_t> fill(cellStart.begin(), cellStart.end() - 1);
+			for (size_t i = 0; i < count; i++)
+				cellClusters[fill[clusterCell[i]]++] = i;
+		}
+
+		// Searches shells of cells outward from the position's cell. Once the block searched so far
+		// is further from the position than the second closest centroid, nothing outside it can win
+		size_t Clusterer::CentroidGrid::findClosest(const std::vector<Cluster>& clusters, const G3D::Vector3& position, size_t exclude, float& distance, float& secondDistance) const
+		{
+			size_t closest = npos;
+			distance = G3D::inf();
+			secondDistance = G3D::inf();
+
+			int center[3] = { cell(position, 0), cell(position, 1), cell(position, 2) };
+			int maxRing = G3D::iMax(size[0], G3D::iMax(size[1], size[2]));
+
+			for (int ring = 0; ring <= maxRing; ring++)
+			{
+				int z0 = G3D::iMax(center[2] - ring, 0), z1 = G3D::iMin(center[2] + ring, size[2] - 1);
+				int y0 = G3D::iMax(center[1] - ring, 0), y1 = G3D::iMin(center[1] + ring, size[1] - 1);
+				int x0 = G3D::iMax(center[0] - ring, 0), x1 = G3D::iMin(center[0] + ring, size[0] - 1);
+
+				for (int z = z0; z <= z1; z++)
+				{
+					bool zShell = abs(z - center[2]) == ring;
+					for (int y = y0; y <= y1; y++)
+					{
+						bool yShell = zShell || abs(y - center[1]) == ring;
+
+						// away from the y and z faces only the two x faces are new
+						int xStep = yShell ? 1 : 2 * ring;
+						for (int x = yShell ? x0 : center[0] - ring; x <= x1; x += xStep)
+						{
+							if (x < x0)
+								continue;
+
+							size_t c = ((size_t)z * size[1] + y) * size[0] + x;
+							for (size_t i = cellStart[c]; i < cellStart[c + 1]; i++)
+							{
+								size_t cluster = cellClusters[i];
+								if (cluster == exclude)
+									continue;
+
+								float d = (clusters[cluster].centroid - position).magnitude();
+								if (d < distance)
+								{
+									secondDistance = distance;
+									distance = d;
+									closest = cluster;
+								}
+								else if (d < secondDistance)
+								{
+									secondDistance = d;
+								}
+							}
+						}
+					}
+				}
+
+				// how far the unsearched cells are; faces on the edge of the grid have nothing beyond them
+				float bound = G3D::inf();
+				for (int axis = 0; axis < 3; axis++)
+				{
+					if (center[axis] - ring > 0)
+						bound = G3D::min(bound, position[axis] - (low[axis] + (center[axis] - ring) * cellSize));
+					if (center[axis] + ring + 1 < size[axis])
+						bound = G3D::min(bound, low[axis] + (center[axis] + ring + 1) * cellSize - position[axis]);
+				}
+
+				if (bound == G3D::inf() || secondDistance <= bound)
+					break;
+			}
+
+			return closest;
+		}
+
 		Clusterer::Clusterer(size_t clusterCount)
 			: sampleSize(0),
 			  clusterCount(clusterCount),
-			  clusters(clusterCount)
+			  seededClusters(0),
+			  clusters(clusterCount),
+			  unassignedCount(0),
+			  settledSamples(false),
+			  low(G3D::Vector3::inf()),
+			  high(-G3D::Vector3::inf())
 		{
 		}
 
-		void Clusterer::Cluster::computeCentroid()
+		void Clusterer::addSample(Chunk* sample)
+		{
+			if (sampleIndex.find(sample) != sampleIndex.end())
+				return;
+
+			sampleIndex[sample] = samples.size();
+
+			Sample s;
+			s.chunk = sample;
+			s.position = sample->cframe().translation;
+			s.cluster = npos;
+			s.slot = 0;
+			s.upper = G3D::inf();
+			s.lower = 0.0f;
+			samples.push_back(s);
+
+			low = low.min(s.position);
+			high = high.max(s.position);
+
+			sampleSize++;
+			unassignedCount++;
+			settledSamples = false;
+		}
+
+		void Clusterer::removeSample(Chunk* sample)
 		{
-			G3D::Vector3 c(0.0f, 0.0f, 0.0f);
+			stdext::hash_map<Chunk*, size_t>::iterator iter = sampleIndex.find(sample);
+			if (iter == sampleIndex.end())
+				return;
+
+			size_t index = iter->second;
+			sampleIndex.erase(iter);
 
-			std::vector<Chunk*>::iterator iter = samples.begin();
-			std::vector<Chunk*>::iterator end = samples.end();
+			if (samples[index].cluster != npos)
+				removeFromCluster(index);
+			else
+				unassignedCount--;
 
-			for (; iter != end; iter++)
+			// the last sample takes its place
+			size_t last = samples.size() - 1;
+			if (index != last)
 			{
-				c += (*iter)->cframe().translation;
+				samples[index] = samples[last];
+
+				const Sample& moved = samples[index];
+				sampleIndex[moved.chunk] = index;
+				if (moved.cluster != npos)
+					clusters[moved.cluster].members[moved.slot] = index;
 			}
 
-			centroid = c / samples.size();
+			samples.pop_back();
+			sampleSize--;
 		}
 
-		float Clusterer::Cluster::getDistanceFromCentroid(Chunk* sample)
+		void Clusterer::removeFromCluster(size_t sample)
 		{
-			return (sample->cframe().translation - centroid).magnitude();
+			Sample& s = samples[sample];
+			Cluster& cluster = clusters[s.cluster];
+
+			size_t last = cluster.members.back();
+			cluster.members[s.slot] = last;
+			cluster.samples[s.slot] = cluster.samples.back();
+			samples[last].slot = s.slot;
+
+			cluster.members.pop_back();
+			cluster.samples.pop_back();
+
+			cluster.sum[0] -= s.position.x;
+			cluster.sum[1] -= s.position.y;
+			cluster.sum[2] -= s.position.z;
+
+			s.cluster = npos;
 		}
 
-		Clusterer::Cluster& Clusterer::findClosestCluster(Chunk* sample)
+		size_t Clusterer::moveSample(size_t sample, size_t cluster)
 		{
-			Cluster* bestCluster = NULL;
-			float bestDistance = G3D::inf();
+			Sample& s = samples[sample];
+			if (s.cluster != npos)
+				removeFromCluster(sample);
 
-			std::vector<Cluster>::iterator end = clusters.end();
+			Cluster& target = clusters[cluster];
+			s.cluster = cluster;
+			s.slot = target.samples.size();
+			target.samples.push_back(s.chunk);
+			target.members.push_back(sample);
 
-			for (std::vector<Cluster>::iterator iter = clusters.begin(); iter != end; iter++)
+			target.sum[0] += s.position.x;
+			target.sum[1] += s.position.y;
+			target.sum[2] += s.position.z;
+
+			return 1;
+		}
+
+		size_t Clusterer::findClosestCluster(const G3D::Vector3& position, float& distance, float& secondDistance) const
+		{
+			return grid.findClosest(clusters, position, npos, distance, secondDistance);
+		}
+
+		// k-means++: each new centroid is a sample picked with probability proportional to its
+		// squared distance from the closest centroid so far. Samples are kept with their closest
+		// centroid, so a new one only has to look through clusters it could take samples from
+		void Clusterer::seed()
+		{
+			if (seededClusters == 0)
 			{
-				float distance = iter->getDistanceFromCentroid(sample);
-				if (distance < bestDistance)
+				size_t first = (size_t)G3D::iRandom(0, (int)samples.size() - 1);
+				clusters[0].centroid = samples[first].position;
+				seededClusters = 1;
+
+				for (size_t i = 0; i < samples.size(); i++)
 				{
-					bestCluster = &(*iter);
-					bestDistance = distance;
+					if (samples[i].cluster != 0)
+						moveSample(i, 0);
 				}
-			}
 
-			return *bestCluster;
-		}
+				unassignedCount = 0;
+			}
+			else
+			{
+				assignSamples();
+			}
 
-		size_t Clusterer::moveSamples()
-		{
-			size_t moveCount = 0;
+			std::vector<double> weight(clusterCount, 0.0);
+			std::vector<float> radius(clusterCount, 0.0f);
 
-			for (std::vector<Cluster>::iterator it = clusters.begin(); it != clusters.end(); it++)
+			for (size_t c = 0; c < seededClusters; c++)
 			{
-				it->visitIndex = 0;
+				Cluster& cluster = clusters[c];
+				for (size_t m = 0; m < cluster.members.size(); m++)
+				{
+					Sample& s = samples[cluster.members[m]];
+					s.upper = (s.position - cluster.centroid).magnitude();
+					weight[c] += (double)s.upper * s.upper;
+					radius[c] = G3D::max(radius[c], s.upper);
+				}
 			}
 
-			for (std::vector<Cluster>::iterator it = clusters.begin(); it != clusters.end(); it++)
+			while (seededClusters < clusterCount && seededClusters < sampleSize)
 			{
-				Cluster& cluster = *it;
+				double total = 0.0;
+				for (size_t c = 0; c < seededClusters; c++)
+					total += weight[c];
+
+				// every sample sits on a centroid already
+				if (total <= 0.0)
+					break;
 
-				while (cluster.visitIndex < cluster.samples.size())
+				double pick = G3D::uniformRandom(0.0, total);
+				size_t from = npos;
+				for (size_t c = 0; c < seededClusters; c++)
 				{
-					Chunk* sample = cluster.samples[cluster.visitIndex];
-					Cluster& bestCluster = findClosestCluster(sample);
+					if (weight[c] <= 0.0)
+						continue;
 
-					if (&bestCluster != &cluster)
-					{
-						cluster.samples[cluster.visitIndex] = *(cluster.samples.end() - 1);
-						cluster.samples.pop_back();
+					from = c;
+					if (pick < weight[c])
+						break;
+
+					pick -= weight[c];
+				}
 
-						moveCount += moveSample(sample, bestCluster);
+				const Cluster& fromCluster = clusters[from];
+				size_t chosen = fromCluster.members.back();
+				for (size_t m = 0; m < fromCluster.members.size(); m++)
+				{
+					const Sample& s = samples[fromCluster.members[m]];
+					pick -= (double)s.upper * s.upper;
+					if (pick < 0.0)
+					{
+						chosen = fromCluster.members[m];
+						break;
 					}
-					else
+				}
+
+				size_t added = seededClusters++;
+				clusters[added].centroid = samples[chosen].position;
+
+				for (size_t c = 0; c < added; c++)
+				{
+					// no sample of this cluster can be closer to the new centroid than to its own
+					if ((clusters[c].centroid - clusters[added].centroid).magnitude() >= 2.0f * radius[c])
+						continue;
+
+					Cluster& cluster = clusters[c];
+					weight[c] = 0.0;
+					radius[c] = 0.0f;
+
+					size_t m = 0;
+					while (m < cluster.members.size())
 					{
-						cluster.visitIndex++;
+						size_t index = cluster.members[m];
+						Sample& s = samples[index];
+						float d = (s.position - clusters[added].centroid).magnitude();
+
+						if (d < s.upper)
+						{
+							s.upper = d;
+							moveSample(index, added);
+							weight[added] += (double)d * d;
+							radius[added] = G3D::max(radius[added], d);
+						}
+						else
+						{
+							weight[c] += (double)s.upper * s.upper;
+							radius[c] = G3D::max(radius[c], s.upper);
+							m++;
+						}
 					}
 				}
 			}
 
+			// every sample is with its closest seed; the first iteration checks them all again anyway
+			for (size_t i = 0; i < samples.size(); i++)
+				samples[i].lower = 0.0f;
+
+			computeCentroids();
+		}
+
+		void Clusterer::assignSamples()
+		{
+			if (unassignedCount == 0)
+				return;
+
+			grid.build(low, high, clusters, seededClusters);
+
+			for (size_t i = 0; i < samples.size(); i++)
+			{
+				Sample& s = samples[i];
+				if (s.cluster != npos)
+					continue;
+
+				float distance, secondDistance;
+				size_t closest = findClosestCluster(s.position, distance, secondDistance);
+				moveSample(i, closest);
+				s.upper = distance;
+				s.lower = secondDistance;
+			}
+
+			unassignedCount = 0;
+		}
+
+		void Clusterer::computeSeparations()
+		{
+			grid.build(low, high, clusters, seededClusters);
+
+			for (size_t c = 0; c < seededClusters; c++)
+			{
+				float distance, secondDistance;
+				grid.findClosest(clusters, clusters[c].centroid, c, distance, secondDistance);
+				clusters[c].halfSeparation = distance * 0.5f;
+			}
+		}
+
+		// Moving centroids loosen every sample's bounds by how far they moved
+		void Clusterer::computeCentroids()
+		{
+			std::vector<float> drift(seededClusters, 0.0f);
+			size_t furthest = 0;
+			float maxDrift = 0.0f;
+			float secondDrift = 0.0f;
+
+			for (size_t c = 0; c < seededClusters; c++)
+			{
+				G3D::Vector3 old = clusters[c].centroid;
+				clusters[c].computeCentroid();
+				drift[c] = (clusters[c].centroid - old).magnitude();
+
+				if (drift[c] > maxDrift)
+				{
+					secondDrift = maxDrift;
+					maxDrift = drift[c];
+					furthest = c;
+				}
+				else if (drift[c] > secondDrift)
+				{
+					secondDrift = drift[c];
+				}
+			}
+
+			for (size_t i = 0; i < samples.size(); i++)
+			{
+				Sample& s = samples[i];
+				if (s.cluster == npos)
+					continue;
+
+				s.upper += drift[s.cluster];
+				s.lower -= s.cluster == furthest ? secondDrift : maxDrift;
+			}
+		}
+
+		size_t Clusterer::moveSamples()
+		{
+			size_t moveCount = 0;
+
+			computeSeparations();
+
+			for (size_t i = 0; i < samples.size(); i++)
+			{
+				Sample& s = samples[i];
+				const Cluster& cluster = clusters[s.cluster];
+
+				float bound = G3D::max(cluster.halfSeparation, s.lower);
+				if (s.upper <= bound)
+					continue;
+
+				s.upper = (s.position - cluster.centroid).magnitude();
+				if (s.upper <= bound)
+					continue;
+
+				float distance, secondDistance;
+				size_t closest = findClosestCluster(s.position, distance, secondDistance);
+
+				if (closest != s.cluster && distance < s.upper)
+					moveCount += moveSample(i, closest);
+
+				s.upper = (s.position - clusters[s.cluster].centroid).magnitude();
+				s.lower = s.cluster == closest ? secondDistance : distance;
+			}
+
+			computeCentroids();
+
 			return moveCount;
 		}
 
-		template<class Iterator>
-		void Clusterer::addSamples(Iterator _Iter, Iterator _End)
+		std::vector<Clusterer::Cluster>& Clusterer::go(size_t iterations)
 		{
-			size_t currentCluster = 0;
+			if (sampleSize == 0)
+			{
+				settledSamples = true;
+				return clusters;
+			}
 
-			for (; _Iter != _End; _Iter++)
+			if (seededClusters < clusterCount && seededClusters < sampleSize)
 			{
-				clusters[currentCluster].samples.push_back(_Iter->pointer()); // NOTE: this function may have been specialized, although only one template parameter for this function exists in RBXGS
+				seed();
+			}
+			else
+			{
+				// samples added or removed since the last run have moved the centroids
+				assignSamples();
+				computeCentroids();
+			}
 
-				currentCluster = (currentCluster + 1) % clusterCount;
-				sampleSize++;
+			for (size_t i = 0; i < iterations; i++)
+			{
+				settledSamples = moveSamples() == 0;
+				if (settledSamples)
+					break;
 			}
+
+			return clusters;
 		}
 	}
 }
@@ -1,37 +1,110 @@
 #pragma once
 #include "RenderLib/Chunk.h"
+#include <hash_map>
+#include <vector>
 
 namespace RBX
 {
 	namespace Render
 	{
+		// k-means over chunk positions. Clusters are seeded with k-means++ and samples then move
+		// between them until they settle. Each sample keeps bounds on its distances to the centroids
+		// (Hamerly), so most of them are never searched again; the searches that are left go through
+		// a grid over the centroids.
+		// Samples can be added and removed between runs, and the next run carries on from the
+		// clusters as they are rather than starting over.
 		class Clusterer
 		{
+		public:
 			class Cluster
 			{
 			public:
 				G3D::Vector3 centroid;
 				std::vector<Chunk*> samples;
-				size_t visitIndex;
+				std::vector<size_t> members;	// alongside samples, indices into Clusterer::samples
+				double sum[3];
+				float halfSeparation;			// half the distance to the nearest other centroid
 			public:
+				Cluster();
 				void computeCentroid();
 				float getDistanceFromCentroid(Chunk* sample);
 			};
 
+		private:
+			struct Sample
+			{
+				Chunk* chunk;
+				G3D::Vector3 position;
+				size_t cluster;		// npos until it has one
+				size_t slot;		// in the cluster's samples
+				float upper;		// at least the distance to its own centroid
+				float lower;		// at most the distance to any other
+			};
+
+			class CentroidGrid
+			{
+				G3D::Vector3 low;
+				float cellSize;
+				int size[3];
+				std::vector<size_t> cellStart;
+				std::vector<size_t> cellClusters;
+			public:
+				void build(const G3D::Vector3& low, const G3D::Vector3& high, const std::vector<Cluster>& clusters, size_t count);
+				size_t findClosest(const std::vector<Cluster>& clusters, const G3D::Vector3& position, size_t exclude, float& distance, float& secondDistance) const;
+			private:
+				int cell(const G3D::Vector3& position, int axis) const;
+			};
+
+			static const size_t npos = (size_t)-1;
+
 		private:
 			size_t sampleSize;
 			const size_t clusterCount;
+			size_t seededClusters;
 			std::vector<Cluster> clusters;
+			std::vector<Sample> samples;
+			stdext::hash_map<Chunk*, size_t> sampleIndex;
+			size_t unassignedCount;
+			bool settledSamples;
+			G3D::Vector3 low;
+			G3D::Vector3 high;
+			CentroidGrid grid;
 		private:
+			void seed();
+			void assignSamples();
+			void computeSeparations();
+			void computeCentroids();
 			size_t moveSamples();
-			size_t moveSample(Chunk* sample, Cluster& cluster);
-			Cluster& findClosestCluster(Chunk* sample);
+			size_t moveSample(size_t sample, size_t cluster);
+			void removeFromCluster(size_t sample);
+			size_t findClosestCluster(const G3D::Vector3& position, float& distance, float& secondDistance) const;
 		public:
 			Clusterer(size_t clusterCount);
+			// Runs up to the given number of iterations, stopping early once nothing moves
 			std::vector<Cluster>& go(size_t);
 
 			template<class Iterator>
-			void addSamples(Iterator _Iter, Iterator _End);
+			void addSamples(Iterator _Iter, Iterator _End)
+			{
+				for (; _Iter != _End; _Iter++)
+					addSample(_Iter->pointer());
+			}
+
+			// True once a pass has moved nothing and no samples have been added since
+			bool settled() const
+			{
+				return settledSamples;
+			}
+
+			// The clusters as the last run left them
+			std::vector<Cluster>& getClusters()
+			{
+				return clusters;
+			}
+
+			// The chunk's position is taken now; remove and add it again if it moves
+			void addSample(Chunk* sample);
+			void removeSample(Chunk* sample);
 		};
 	}
 }
@@ -32,6 +32,16 @@ namespace RBX
 
 		Material::Level::~Level() {}
 
+		float Material::Level::specular() const
+		{
+			return mSpecular;
+		}
+
+		float Material::Level::shiny() const
+		{
+			return mShiny;
+		}
+
 		void Material::Level::configureRenderDevice(G3D::RenderDevice* renderDevice) const
 		{
 			renderDevice->setColor(mColor);
@@ -27,6 +27,28 @@ namespace RBX
 
 		Mesh::~Mesh() {}
 
+		// Like Material::detailLevel: 0 picks the first level, 1 the last
+		int Mesh::detailIndex(double lvl) const
+		{
+			int sizeMinusOne = levels.size() - 1;
+			int index = (int)(lvl * levels.size());
+
+			if (index <= 0)
+				return 0;
+			else if (index >= sizeMinusOne)
+				return sizeMinusOne;
+			else
+				return index;
+		}
+
+		const G3D::ReferenceCountedPointer<Mesh::Level> Mesh::detailLevel(float lvl) const
+		{
+			if (levels.size() == 0)
+				return G3D::ReferenceCountedPointer<Level>();
+
+			return levels[detailIndex(lvl)];
+		}
+
 		void Mesh::endRender(G3D::RenderDevice* rd)
 		{
 			rd->endIndexedPrimitives();
@@ -1,4 +1,6 @@
 #include "RenderLib/RenderScene.h"
+#include "util/boost.hpp"
+#include <boost/bind.hpp>
 
 namespace RBX
 {
@@ -10,7 +12,8 @@ namespace RBX
 			  debugShadowVolumes(false),
 			  meshDetail(-1.0f),
 			  cameraDistance(G3D::inf()),
-			  colorClearValue(G3D::Color3(0.5f, 0.5f, 1.0f))
+			  colorClearValue(G3D::Color3(0.5f, 0.5f, 1.0f)),
+			  shadowPass(0)
 		{
 			desiredLighting = lighting = G3D::Lighting::create();
 		}
@@ -154,6 +157,94 @@ namespace RBX
 			lighting = effectSettings.update(shadingQuality, meshDetail, shadows, cameraDistance, desiredLighting, desiredSkyParameters, skyParameters);
 		}
 
+		// proxies per parallel_for iteration
+		static const int silhouetteBatch = 16;
+
+		// silhouette caches for lights that haven't been rendered in this many passes are dropped
+		static const int silhouetteCachePasses = 8;
+
+		bool RenderScene::SilhouetteKey::operator<(const SilhouetteKey& other) const
+		{
+			if (mesh != other.mesh)
+				return mesh < other.mesh;
+
+			const float* a = &cframe.rotation[0][0];
+			const float* b = &other.cframe.rotation[0][0];
+			for (int i = 0; i < 9; i++)
+			{
+				if (a[i] != b[i])
+					return a[i] < b[i];
+			}
+
+			for (int i = 0; i < 3; i++)
+			{
+				if (cframe.translation[i] != other.cframe.translation[i])
+					return cframe.translation[i] < other.cframe.translation[i];
+			}
+
+			return false;
+		}
+
+		RenderScene::SilhouetteCache& RenderScene::silhouetteCache(const G3D::Vector3& lightDirection, bool lightCap) const
+		{
+			std::list<SilhouetteCache>::iterator iter = silhouetteCaches.begin();
+			while (iter != silhouetteCaches.end())
+			{
+				if (iter->lightDirection == lightDirection && iter->lightCap == lightCap)
+					return *iter;
+
+				if (shadowPass - iter->lastUsed > silhouetteCachePasses)
+					iter = silhouetteCaches.erase(iter);
+				else
+					++iter;
+			}
+
+			SilhouetteCache cache;
+			cache.lightDirection = lightDirection;
+			cache.lightCap = lightCap;
+			cache.lastUsed = shadowPass;
+			silhouetteCaches.push_back(cache);
+			return silhouetteCaches.back();
+		}
+
+		void RenderScene::computeSilhouettes(size_t batch, const G3D::Vector3* lightDirection, bool lightCap) const
+		{
+			int end = G3D::min((int)(batch + 1) * silhouetteBatch, staleSilhouettes.size());
+			for (int i = (int)batch * silhouetteBatch; i < end; i++)
+			{
+				ShadowSilhouette* silhouette = staleSilhouettes[i];
+				const RenderSurface& proxy = shadowProxyArray[silhouette->proxy];
+
+				silhouette->indexArray.fastClear();
+				silhouette->vertexArray.fastClear();
+				silhouette->vertexArray.append(G3D::Vector3::zero());
+
+				proxy.fullMesh->computeDirectionalShadowVolume(proxy.cframe, *lightDirection, silhouette->indexArray, silhouette->vertexArray, lightCap);
+			}
+		}
+
+		void RenderScene::mergeSilhouettes(size_t batch, G3D::Array<unsigned>* indexArray, G3D::Array<G3D::Vector3>* shadowVertex) const
+		{
+			int end = G3D::min((int)(batch + 1) * silhouetteBatch, passSilhouettes.size());
+			for (int i = (int)batch * silhouetteBatch; i < end; i++)
+			{
+				const ShadowSilhouette* silhouette = passSilhouettes[i];
+
+				// the silhouette's own vertices start at 1, which lands them at the proxy's offset
+				int vertexOffset = passVertexOffsets[i] - 1;
+				G3D::Vector3* vertex = shadowVertex->getCArray() + vertexOffset;
+				for (int v = 1; v < silhouette->vertexArray.size(); v++)
+					vertex[v] = silhouette->vertexArray[v];
+
+				unsigned* index = indexArray->getCArray() + passIndexOffsets[i];
+				for (int n = 0; n < silhouette->indexArray.size(); n++)
+				{
+					unsigned value = silhouette->indexArray[n];
+					index[n] = value == 0 ? 0 : value + vertexOffset;
+				}
+			}
+		}
+
 		void RenderScene::computeShadowVolumeGeometry(G3D::Array<unsigned>& indexArray, G3D::Array<G3D::Vector3>& shadowVertex, const G3D::GLight& light, bool generateLightCap, float shadowVertexDistance) const
 		{
 			renderStats.cpuShadow.tick();
@@ -164,10 +255,67 @@ namespace RBX
 
 			G3D::Vector3 worldLight = light.position.xyz().direction();
 
+			// Find each proxy's silhouette from earlier passes, or make room for a new one. A proxy
+			// that has moved gets a new entry and its old one goes below
+			++shadowPass;
+			SilhouetteCache& cache = silhouetteCache(worldLight, generateLightCap);
+			cache.lastUsed = shadowPass;
+
+			passSilhouettes.fastClear();
+			staleSilhouettes.fastClear();
+
 			for (int i = 0; i < shadowProxyArray.size(); i++)
 			{
 				const RenderSurface& current = shadowProxyArray[i];
-				current.fullMesh->computeDirectionalShadowVolume(current.cframe, worldLight, indexArray, shadowVertex, generateLightCap);
+
+				SilhouetteKey key;
+				key.mesh = current.fullMesh.pointer();
+				key.cframe = current.cframe;
+
+				ShadowSilhouette& silhouette = cache.silhouettes[key];
+				if (silhouette.mesh.isNull())
+				{
+					silhouette.mesh = current.fullMesh;
+					staleSilhouettes.append(&silhouette);
+				}
+
+				silhouette.lastUsed = shadowPass;
+				silhouette.proxy = i;
+				passSilhouettes.append(&silhouette);
+			}
+
+			thread_pool& pool = thread_pool::singleton();
+			pool.parallel_for((staleSilhouettes.size() + silhouetteBatch - 1) / silhouetteBatch, boost::bind(&RenderScene::computeSilhouettes, this, _1, &worldLight, generateLightCap));
+
+			renderStats.shadowSilhouettesComputed = staleSilhouettes.size();
+			renderStats.shadowSilhouettesReused = passSilhouettes.size() - staleSilhouettes.size();
+
+			// prefix sums place every silhouette in the combined arrays
+			passVertexOffsets.resize(passSilhouettes.size(), false);
+			passIndexOffsets.resize(passSilhouettes.size(), false);
+
+			int vertexCount = shadowVertex.size();
+			int indexCount = 0;
+			for (int i = 0; i < passSilhouettes.size(); i++)
+			{
+				passVertexOffsets[i] = vertexCount;
+				passIndexOffsets[i] = indexCount;
+				vertexCount += passSilhouettes[i]->vertexArray.size() - 1;
+				indexCount += passSilhouettes[i]->indexArray.size();
+			}
+
+			shadowVertex.resize(vertexCount, false);
+			indexArray.resize(indexCount, false);
+
+			pool.parallel_for((passSilhouettes.size() + silhouetteBatch - 1) / silhouetteBatch, boost::bind(&RenderScene::mergeSilhouettes, this, _1, &indexArray, &shadowVertex));
+
+			std::map<SilhouetteKey, ShadowSilhouette>::iterator iter = cache.silhouettes.begin();
+			while (iter != cache.silhouettes.end())
+			{
+				if (iter->second.lastUsed != shadowPass)
+					cache.silhouettes.erase(iter++);
+				else
+					++iter;
 			}
 
 			renderStats.cpuShadow.tock();
@@ -203,15 +351,117 @@ namespace RBX
 			classifyProxies();
 
 			renderStats.sort.tick();
+			sortProxies();
+			renderStats.sort.tock();
+			renderStats.computeProxyArrays.tock();
+
+			renderStats.diffuseProxyCount = diffuseProxyArray.size();
+		}
+
+		bool RenderScene::allocateProxy(Chunk* chunk, const G3D::CoordinateFrame& cameraFrame, RenderSurface& proxy) const
+		{
+			G3D::ReferenceCountedPointer<Mesh> mesh = chunk->getMesh();
+			G3D::ReferenceCountedPointer<Material> material = chunk->getMaterial();
+			if (mesh.isNull() || material.isNull())
+				return false;
+
+			const Mesh::Level* level = mesh->detailLevel(0.0f).pointer();
+			if (!level)
+				return false;
+
+			proxy.cframe = chunk->cframe();
+			proxy.z = cameraFrame.pointToObjectSpace(proxy.cframe.translation).z;
+			proxy.material = material->detailLevel(0.0f);
+			proxy.polygonOffset = chunk->polygonOffset;
+			proxy.mesh = level;
+			proxy.fullMesh = mesh;
+			return true;
+		}
+
+		void RenderScene::allocateProxies(G3D::RenderDevice* rd, const G3D::GCamera& camera)
+		{
+			allocateProxies(camera, rd->getViewport(), true);
+		}
+
+		void RenderScene::allocateProxies(const G3D::GCamera& camera, const G3D::Rect2D& viewport, bool cacheShadows)
+		{
+			const G3D::CoordinateFrame& cameraFrame = camera.getCoordinateFrame();
+
+			chunkHierarchy.update();
+
+			camera.getClipPlanes(viewport, cullPlanes);
+			chunkHierarchy.cull(cullPlanes, visibleChunks);
+
+			proxyChunks.fastClear();
+			for (int i = 0; i < visibleChunks.size(); i++)
+			{
+				RenderSurface& proxy = proxyArray.next();
+				if (allocateProxy(visibleChunks[i], cameraFrame, proxy))
+					proxyChunks.append(i);
+				else
+					proxyArray.pop();
+			}
+
+			const G3D::Array<G3D::GLight>& shadowedLights = lighting->shadowedLightArray;
+			if (!effectSettings.stencilShadows() || shadowedLights.size() == 0)
+				return;
+
+			// Chunks outside the view still throw shadows into it, but a plane the shadows only
+			// head further out through can reject them. Point lights throw them every way
+			G3D::Array<G3D::Plane> shadowPlanes;
+			for (int p = 0; p < cullPlanes.size(); p++)
+			{
+				bool away = true;
+				for (int l = 0; l < shadowedLights.size() && away; l++)
+				{
+					const G3D::Vector4& position = shadowedLights[l].position;
+					away = position.w == 0.0f && cullPlanes[p].normal().dot(position.xyz()) >= 0.0f;
+				}
+
+				if (away)
+					shadowPlanes.append(cullPlanes[p]);
+			}
+
+			chunkHierarchy.find(shadowPlanes, shadowChunks);
+
+			for (int i = 0; i < shadowChunks.size(); i++)
+			{
+				Chunk* chunk = shadowChunks[i];
+				if (!chunk->castsShadows())
+					continue;
+
+				G3D::ReferenceCountedPointer<Material> material = chunk->getMaterial();
+				if (material.isNull() || material->veryTransparent())
+					continue;
+
+				// the GL path leaves chunks that cache their shadows to draw their own volumes
+				if (cacheShadows && chunk->cachesShadows())
+				{
+					shadowCachingChunkArray.append(chunk);
+					continue;
+				}
+
+				RenderSurface& proxy = shadowProxyArray.next();
+				if (!allocateProxy(chunk, cameraFrame, proxy))
+					shadowProxyArray.pop();
+			}
+		}
 
+		void RenderScene::sortProxies()
+		{
 			sortByMaterialAndDepth(diffuseProxyArray);
 			sortByMaterial(reflectProxyArray);
 			sortByDepth(transparentProxyArray);
 
-			renderStats.sort.tock();
-			renderStats.computeProxyArrays.tock();
+			// The hierarchy hands the chunks back in this order next frame, so the proxies come
+			// out nearly sorted and the sorts above have little left to do
+			drawOrder.fastClear();
+			for (int i = 0; i < diffuseProxyArray.size(); i++)
+				drawOrder.append(proxyChunks[(int)(diffuseProxyArray[i] - proxyArray.getCArray())]);
+			for (int i = 0; i < transparentProxyArray.size(); i++)
+				drawOrder.append(proxyChunks[(int)(transparentProxyArray[i] - proxyArray.getCArray())]);
 
-			renderStats.diffuseProxyCount = diffuseProxyArray.size();
+			chunkHierarchy.setDrawOrder(drawOrder);
 		}
 
 		void RenderScene::presetLighting(G3D::ReferenceCountedPointer<G3D::Sky> sky, G3D::LightingParameters skyParameters, G3D::Color3 ambientTop, G3D::Color3 ambientBottom)
@@ -469,5 +719,198 @@ namespace RBX
 
 			rd->popState();
 		}
+
+		static G3D::Color3 softwareLightContribution(const G3D::GLight& light, const G3D::Vector3& position, const G3D::Vector3& normal, const G3D::Vector3& eye, const Material::Level* material)
+		{
+			G3D::Vector3 toLight;
+			float attenuation = 1.0f;
+
+			if (light.position.w == 0.0f)
+			{
+				toLight = light.position.xyz().direction();
+			}
+			else
+			{
+				toLight = light.position.xyz() - position;
+				float distance = toLight.magnitude();
+				toLight /= distance;
+				attenuation = 1.0f / (light.attenuation[0] + light.attenuation[1] * distance + light.attenuation[2] * distance * distance);
+			}
+
+			float diffuse = normal.dot(toLight);
+			if (diffuse <= 0.0f)
+				return G3D::Color3::black();
+
+			G3D::Color3 result = G3D::Color3::black();
+			if (light.diffuse)
+				result += material->color() * light.color * diffuse;
+
+			if (light.specular && material->specular() > 0.0f)
+			{
+				G3D::Vector3 halfVector = (toLight + (eye - position).direction()).direction();
+				float specular = G3D::max(normal.dot(halfVector), 0.0f);
+				result += light.color * material->specular() * pow(specular, material->shiny());
+			}
+
+			return result * attenuation;
+		}
+
+		// Lights every corner the way the fixed function pipeline does, once with only the
+		// unshadowed lights and once with all of them
+		void RenderScene::lightSoftwareProxy(size_t index, const G3D::Vector3* eye)
+		{
+			const RenderSurface& proxy = proxyArray[(int)index];
+			std::vector<SoftwareRasterizer::Vertex>& vertices = softwareVertices[index];
+			vertices.clear();
+
+			if (!proxy.material)
+				return;
+
+			const G3D::MeshAlg::Geometry& geometry = Mesh::geometry();
+			const G3D::Array<unsigned>& indices = proxy.mesh->indexArray;
+			bool quads = proxy.mesh->primitive == G3D::RenderDevice::QUADS;
+			int corners = quads ? 4 : 3;
+
+			G3D::Color3 ambient = (lighting->ambientTop + lighting->ambientBottom) / 2.0f;
+			float alpha = 1.0f - proxy.material->transparent();
+
+			SoftwareRasterizer::Vertex corner[4];
+			for (int start = 0; start + corners <= indices.size(); start += corners)
+			{
+				for (int c = 0; c < corners; c++)
+				{
+					unsigned i = indices[start + c];
+					G3D::Vector3 position = proxy.cframe.pointToWorldSpace(geometry.vertexArray[i]);
+					G3D::Vector3 normal = proxy.cframe.vectorToWorldSpace(geometry.normalArray[i]);
+
+					G3D::Color3 unlit = ambient;
+					if (effectSettings.hemisphereLighting())
+						unlit = lighting->ambientBottom + (lighting->ambientTop - lighting->ambientBottom) * (normal.y * 0.5f + 0.5f);
+					unlit *= proxy.material->color();
+
+					for (int l = 0; l < lighting->lightArray.size(); l++)
+						unlit += softwareLightContribution(lighting->lightArray[l], position, normal, *eye, proxy.material);
+
+					// only the first shadowed light casts a volume; the others light shadowed pixels too
+					for (int l = 1; l < lighting->shadowedLightArray.size(); l++)
+						unlit += softwareLightContribution(lighting->shadowedLightArray[l], position, normal, *eye, proxy.material);
+
+					G3D::Color3 lit = unlit;
+					if (lighting->shadowedLightArray.size() > 0)
+						lit += softwareLightContribution(lighting->shadowedLightArray[0], position, normal, *eye, proxy.material);
+
+					corner[c].position = position;
+					corner[c].lit = lit;
+					corner[c].unlit = unlit;
+					corner[c].alpha = alpha;
+				}
+
+				vertices.push_back(corner[0]);
+				vertices.push_back(corner[1]);
+				vertices.push_back(corner[2]);
+
+				if (quads)
+				{
+					vertices.push_back(corner[0]);
+					vertices.push_back(corner[2]);
+					vertices.push_back(corner[3]);
+				}
+			}
+		}
+
+		void RenderScene::sendSoftwareProxies(SoftwareRasterizer& target, const G3D::Array<RenderSurface*>& proxies, SoftwareRasterizer::PassMode mode) const
+		{
+			target.beginPass(mode);
+
+			for (int p = 0; p < proxies.size(); p++)
+			{
+				const RenderSurface* proxy = proxies[p];
+				const std::vector<SoftwareRasterizer::Vertex>& vertices = softwareVertices[proxy - proxyArray.getCArray()];
+
+				if (mode == SoftwareRasterizer::AdditivePass)
+				{
+					// no environment map here; the sky's ambient color stands in for it
+					G3D::Color3 reflection = lighting->ambientTop * proxy->material->reflect();
+					for (size_t v = 0; v + 2 < vertices.size(); v += 3)
+					{
+						SoftwareRasterizer::Vertex corner[3] = { vertices[v], vertices[v + 1], vertices[v + 2] };
+						for (int c = 0; c < 3; c++)
+							corner[c].lit = reflection;
+
+						target.addTriangle(corner[0], corner[1], corner[2], proxy->polygonOffset);
+					}
+				}
+				else
+				{
+					for (size_t v = 0; v + 2 < vertices.size(); v += 3)
+						target.addTriangle(vertices[v], vertices[v + 1], vertices[v + 2], proxy->polygonOffset);
+				}
+			}
+
+			target.endPass();
+		}
+
+		void RenderScene::renderSoftware(SoftwareRasterizer& target, const G3D::GCamera& camera)
+		{
+			renderStats.cpuRenderTotal.tick();
+			renderStats.computeProxyArrays.tick();
+
+			diffuseProxyArray.fastClear();
+			shadowProxyArray.fastClear();
+			reflectProxyArray.fastClear();
+			transparentProxyArray.fastClear();
+			proxyArray.fastClear();
+			shadowCachingChunkArray.fastClear();
+
+			allocateProxies(camera, G3D::Rect2D::xywh(0, 0, (float)target.getWidth(), (float)target.getHeight()), false);
+			classifyProxies();
+			sortProxies();
+
+			G3D::Vector3 eye = camera.getCoordinateFrame().translation;
+			softwareVertices.resize(proxyArray.size());
+			thread_pool::singleton().parallel_for(proxyArray.size(), boost::bind(&RenderScene::lightSoftwareProxy, this, _1, &eye));
+
+			renderStats.computeProxyArrays.tock();
+			renderStats.diffuseProxyCount = diffuseProxyArray.size();
+
+			target.setCamera(camera);
+			target.clear(colorClearValue);
+
+			sendSoftwareProxies(target, diffuseProxyArray, SoftwareRasterizer::OpaquePass);
+
+			// One shadow volume, for the first shadowed light. Light from the others reaches every pixel
+			if (effectSettings.stencilShadows() && lighting->shadowedLightArray.size() > 0)
+			{
+				float farPlane = G3D::min(10000.0f, -camera.getFarPlaneZ() * 0.2f);
+
+				G3D::Array<G3D::Vector3> shadowVertex;
+				computeShadowVolumeGeometry(shadowIndexArray, shadowVertex, lighting->shadowedLightArray[0], true, farPlane);
+
+				target.beginPass(SoftwareRasterizer::ShadowVolumePass);
+
+				SoftwareRasterizer::Vertex corner[3];
+				for (int i = 0; i + 2 < shadowIndexArray.size(); i += 3)
+				{
+					for (int c = 0; c < 3; c++)
+					{
+						corner[c].position = shadowVertex[shadowIndexArray[i + c]];
+						corner[c].lit = G3D::Color3::black();
+						corner[c].unlit = G3D::Color3::black();
+						corner[c].alpha = 1.0f;
+					}
+
+					target.addTriangle(corner[0], corner[1], corner[2], 0.0f);
+				}
+
+				target.endPass();
+			}
+
+			target.resolveShadows();
+
+			sendSoftwareProxies(target, reflectProxyArray, SoftwareRasterizer::AdditivePass);
+			sendSoftwareProxies(target, transparentProxyArray, SoftwareRasterizer::BlendPass);
+
+			renderStats.cpuRenderTotal.tock();
+		}
 	}
 }
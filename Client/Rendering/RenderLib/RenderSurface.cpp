@@ -20,19 +20,48 @@ namespace RBX
 			return A->material < B->material;
 		}
 
+		// The proxy arrays are built in last frame's order, so they are usually close to sorted
+		// already. Insertion sort does little work then; once it has moved too much the array
+		// wasn't, and std::sort takes over
+		static void sortNearlySorted(G3D::Array<RenderSurface*>& array, bool (*less)(RenderSurface* const&, RenderSurface* const&))
+		{
+			RenderSurface** begin = array.getCArray();
+			int size = array.size();
+			int moveBudget = 8 * size + 64;
+
+			for (int i = 1; i < size; i++)
+			{
+				RenderSurface* item = begin[i];
+				int j = i;
+				while (j > 0 && less(item, begin[j - 1]))
+				{
+					begin[j] = begin[j - 1];
+					j--;
+
+					if (--moveBudget < 0)
+					{
+						begin[j] = item;
+						std::sort(begin, begin + size, less);
+						return;
+					}
+				}
+				begin[j] = item;
+			}
+		}
+
 		void sortByDepth(G3D::Array<RenderSurface*>& array)
 		{
-			std::sort(array.begin(), array.end(), &depthPtrSortProc);
+			sortNearlySorted(array, &depthPtrSortProc);
 		}
 
 		void sortByMaterial(G3D::Array<RenderSurface*>& array)
 		{
-			std::sort(array.begin(), array.end(), &materialPtrSortProc);
+			sortNearlySorted(array, &materialPtrSortProc);
 		}
 
 		void sortByMaterialAndDepth(G3D::Array<RenderSurface*>& array)
 		{
-			std::sort(array.begin(), array.end(), &materialDepthPtrSortProc);
+			sortNearlySorted(array, &materialDepthPtrSortProc);
 		}
 	}
 }
@@ -0,0 +1,302 @@
+#include "RenderLib/SoftwareRasterizer.h"
+#include "util/boost.hpp"
+#include <boost/bind.hpp>
+
+namespace RBX
+{
+	namespace Render
+	{
+		// how far a polygon offset of 1 moves a surface, relative to its depth
+		static const float polygonOffsetScale = 0.001f;
+
+		SoftwareRasterizer::SoftwareRasterizer(int width, int height)
+			: width(width),
+			  height(height),
+			  tilesX((width + tileSize - 1) / tileSize),
+			  tilesY((height + tileSize - 1) / tileSize),
+			  nearZ(-0.1f),
+			  focalLength(1.0f),
+			  mode(OpaquePass),
+			  tileTriangles(tilesX * tilesY)
+		{
+			depth.resize(width * height);
+			litColor.resize(width * height);
+			unlitColor.resize(width * height);
+			stencil.resize(width * height);
+		}
+
+		void SoftwareRasterizer::setCamera(const G3D::GCamera& camera)
+		{
+			cameraFrame = camera.getCoordinateFrame();
+			nearZ = camera.getNearPlaneZ();
+			focalLength = (height * 0.5f) / tan(camera.getFieldOfView() * 0.5f);
+		}
+
+		void SoftwareRasterizer::clear(const G3D::Color3& color)
+		{
+			for (int i = 0; i < width * height; i++)
+			{
+				depth[i] = 0.0f;
+				litColor[i] = color;
+				unlitColor[i] = color;
+				stencil[i] = 0;
+			}
+		}
+
+		void SoftwareRasterizer::beginPass(PassMode mode)
+		{
+			this->mode = mode;
+			triangles.fastClear();
+		}
+
+		SoftwareRasterizer::ScreenVertex SoftwareRasterizer::project(const G3D::Vector3& cameraSpace, const Vertex& vertex) const
+		{
+			ScreenVertex result;
+			result.invW = -1.0f / cameraSpace.z;
+			result.x = width * 0.5f + cameraSpace.x * result.invW * focalLength;
+			result.y = height * 0.5f - cameraSpace.y * result.invW * focalLength;
+			result.lit = vertex.lit * result.invW;
+			result.unlit = vertex.unlit * result.invW;
+			result.alpha = vertex.alpha * result.invW;
+			return result;
+		}
+
+		void SoftwareRasterizer::addTriangle(const Vertex& a, const Vertex& b, const Vertex& c, float depthOffset)
+		{
+			const Vertex* in[3] = { &a, &b, &c };
+			G3D::Vector3 position[3];
+			int inFront = 0;
+			for (int i = 0; i < 3; i++)
+			{
+				position[i] = cameraFrame.pointToObjectSpace(in[i]->position);
+				if (position[i].z <= nearZ)
+					inFront++;
+			}
+
+			if (inFront == 0)
+				return;
+
+			float depthScale = 1.0f - depthOffset * polygonOffsetScale;
+
+			if (inFront == 3)
+			{
+				addClipped(project(position[0], a), project(position[1], b), project(position[2], c), depthScale);
+				return;
+			}
+
+			// clip against the near plane, which leaves a triangle or a quad
+			ScreenVertex clipped[4];
+			int count = 0;
+			for (int i = 0; i < 3; i++)
+			{
+				int j = (i + 1) % 3;
+				bool iFront = position[i].z <= nearZ;
+				bool jFront = position[j].z <= nearZ;
+
+				if (iFront)
+					clipped[count++] = project(position[i], *in[i]);
+
+				if (iFront != jFront)
+				{
+					float t = (nearZ - position[i].z) / (position[j].z - position[i].z);
+
+					Vertex vertex;
+					vertex.lit = in[i]->lit + (in[j]->lit - in[i]->lit) * t;
+					vertex.unlit = in[i]->unlit + (in[j]->unlit - in[i]->unlit) * t;
+					vertex.alpha = in[i]->alpha + (in[j]->alpha - in[i]->alpha) * t;
+
+					G3D::Vector3 point = position[i] + (position[j] - position[i]) * t;
+					point.z = nearZ;
+					clipped[count++] = project(point, vertex);
+				}
+			}
+
+			for (int i = 2; i < count; i++)
+				addClipped(clipped[0], clipped[i - 1], clipped[i], depthScale);
+		}
+
+		void SoftwareRasterizer::addClipped(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c, float depthScale)
+		{
+			// counter clockwise on screen (y down) is clockwise in the world, so a back face
+			float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+			if (area == 0.0f)
+				return;
+
+			bool frontFacing = area < 0.0f;
+			if (!frontFacing && mode != ShadowVolumePass)
+				return;
+
+			// stored front facing so the edge functions are positive inside
+			Triangle& triangle = triangles.next();
+			triangle.v[0] = a;
+			triangle.v[1] = frontFacing ? b : c;
+			triangle.v[2] = frontFacing ? c : b;
+			triangle.depthScale = depthScale;
+			triangle.frontFacing = frontFacing;
+
+			triangle.minX = G3D::iMax(0, (int)floor(G3D::min(a.x, G3D::min(b.x, c.x))));
+			triangle.minY = G3D::iMax(0, (int)floor(G3D::min(a.y, G3D::min(b.y, c.y))));
+			triangle.maxX = G3D::iMin(width - 1, (int)ceil(G3D::max(a.x, G3D::max(b.x, c.x))));
+			triangle.maxY = G3D::iMin(height - 1, (int)ceil(G3D::max(a.y, G3D::max(b.y, c.y))));
+
+			if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+				triangles.pop();
+		}
+
+		void SoftwareRasterizer::endPass()
+		{
+			// Tiles keep their triangles in submission order, so blending comes out as it would on
+			// the card while no two threads ever touch the same pixel
+			for (size_t i = 0; i < tileTriangles.size(); i++)
+				tileTriangles[i].fastClear();
+
+			for (int t = 0; t < triangles.size(); t++)
+			{
+				const Triangle& triangle = triangles[t];
+				for (int ty = triangle.minY / tileSize; ty <= triangle.maxY / tileSize; ty++)
+				{
+					for (int tx = triangle.minX / tileSize; tx <= triangle.maxX / tileSize; tx++)
+						tileTriangles[ty * tilesX + tx].append(t);
+				}
+			}
+
+			thread_pool::singleton().parallel_for(tileTriangles.size(), boost::bind(&SoftwareRasterizer::rasterizeTile, this, _1));
+		}
+
+		void SoftwareRasterizer::rasterizeTile(size_t tile)
+		{
+			int minX = (int)(tile % tilesX) * tileSize;
+			int minY = (int)(tile / tilesX) * tileSize;
+			int maxX = G3D::iMin(minX + tileSize, width) - 1;
+			int maxY = G3D::iMin(minY + tileSize, height) - 1;
+
+			const G3D::Array<int>& bin = tileTriangles[tile];
+			for (int i = 0; i < bin.size(); i++)
+			{
+				const Triangle& triangle = triangles[bin[i]];
+				rasterizeTriangle(triangle, G3D::iMax(minX, triangle.minX), G3D::iMax(minY, triangle.minY), G3D::iMin(maxX, triangle.maxX), G3D::iMin(maxY, triangle.maxY));
+			}
+		}
+
+		// Edge functions stepped across the rectangle, sampling pixel centers. Edges are shared by
+		// neighbouring triangles without drawing their pixels twice (top-left rule)
+		void SoftwareRasterizer::rasterizeTriangle(const Triangle& triangle, int minX, int minY, int maxX, int maxY)
+		{
+			const ScreenVertex& v0 = triangle.v[0];
+			const ScreenVertex& v1 = triangle.v[1];
+			const ScreenVertex& v2 = triangle.v[2];
+
+			// e0 is the edge opposite v0, and so on; each is positive inside
+			float a0 = v2.y - v1.y, b0 = v1.x - v2.x;
+			float a1 = v0.y - v2.y, b1 = v2.x - v0.x;
+			float a2 = v1.y - v0.y, b2 = v0.x - v1.x;
+
+			float area = a0 * (v0.x - v1.x) + b0 * (v0.y - v1.y);
+			if (area <= 0.0f)
+				return;
+
+			float invArea = 1.0f / area;
+
+			float bias0 = (a0 > 0.0f || (a0 == 0.0f && b0 < 0.0f)) ? 0.0f : -1e-6f;
+			float bias1 = (a1 > 0.0f || (a1 == 0.0f && b1 < 0.0f)) ? 0.0f : -1e-6f;
+			float bias2 = (a2 > 0.0f || (a2 == 0.0f && b2 < 0.0f)) ? 0.0f : -1e-6f;
+
+			float px = minX + 0.5f;
+			float py = minY + 0.5f;
+			float row0 = a0 * (px - v1.x) + b0 * (py - v1.y);
+			float row1 = a1 * (px - v2.x) + b1 * (py - v2.y);
+			float row2 = a2 * (px - v0.x) + b2 * (py - v0.y);
+
+			for (int y = minY; y <= maxY; y++)
+			{
+				float e0 = row0;
+				float e1 = row1;
+				float e2 = row2;
+				int pixel = y * width + minX;
+
+				for (int x = minX; x <= maxX; x++, pixel++, e0 += a0, e1 += a1, e2 += a2)
+				{
+					if (e0 + bias0 < 0.0f || e1 + bias1 < 0.0f || e2 + bias2 < 0.0f)
+						continue;
+
+					float w0 = e0 * invArea;
+					float w1 = e1 * invArea;
+					float w2 = e2 * invArea;
+
+					float invW = w0 * v0.invW + w1 * v1.invW + w2 * v2.invW;
+					float z = invW * triangle.depthScale;
+
+					if (mode == ShadowVolumePass)
+					{
+						// z-fail: count the volume's faces behind the visible surface
+						if (z < depth[pixel])
+							stencil[pixel] += triangle.frontFacing ? -1 : 1;
+						continue;
+					}
+
+					if (z < depth[pixel])
+						continue;
+
+					float w = 1.0f / invW;
+					G3D::Color3 lit = (v0.lit * w0 + v1.lit * w1 + v2.lit * w2) * w;
+
+					switch (mode)
+					{
+					case OpaquePass:
+						depth[pixel] = z;
+						litColor[pixel] = lit;
+						unlitColor[pixel] = (v0.unlit * w0 + v1.unlit * w1 + v2.unlit * w2) * w;
+						break;
+					case AdditivePass:
+						litColor[pixel] += lit;
+						break;
+					case BlendPass:
+						{
+							float alpha = (v0.alpha * w0 + v1.alpha * w1 + v2.alpha * w2) * w;
+							litColor[pixel] = litColor[pixel] * (1.0f - alpha) + lit * alpha;
+						}
+						break;
+					default:
+						break;
+					}
+				}
+
+				row0 += b0;
+				row1 += b1;
+				row2 += b2;
+			}
+		}
+
+		void SoftwareRasterizer::resolveShadows()
+		{
+			thread_pool::singleton().parallel_for(tilesY, boost::bind(&SoftwareRasterizer::resolveTile, this, _1));
+		}
+
+		void SoftwareRasterizer::resolveTile(size_t row)
+		{
+			int start = (int)row * tileSize * width;
+			int end = G3D::iMin((int)(row + 1) * tileSize, height) * width;
+			for (int i = start; i < end; i++)
+			{
+				if (stencil[i] != 0)
+					litColor[i] = unlitColor[i];
+
+				stencil[i] = 0;
+			}
+		}
+
+		void SoftwareRasterizer::getImage(G3D::GImage& image) const
+		{
+			image.resize(width, height, 3);
+
+			G3D::uint8* out = image.byte();
+			for (int i = 0; i < width * height; i++)
+			{
+				const G3D::Color3& color = litColor[i];
+				*out++ = (G3D::uint8)G3D::iClamp(G3D::iRound(color.r * 255.0f), 0, 255);
+				*out++ = (G3D::uint8)G3D::iClamp(G3D::iRound(color.g * 255.0f), 0, 255);
+				*out++ = (G3D::uint8)G3D::iClamp(G3D::iRound(color.b * 255.0f), 0, 255);
+			}
+		}
+	}
+}
@@ -1,26 +1,36 @@
 #pragma once
 #include "RenderLib/RenderScene.h"
 #include <boost/noncopyable.hpp>
-#include <map>
-#include <set>
+#include <hash_map>
+#include <memory>
 
 namespace RBX
 {
 	namespace Render
 	{
+		class Clusterer;
+
 		class AggregatingSceneManager : public SceneManager
 		{
+			// Sleeping chunks that can share an aggregate. Queued chunks know their bucket and
+			// their place in the queue (Chunk::sleepingBucket), so they leave it in constant time
 			class Bucket : public G3D::ReferenceCountedObject, public boost::noncopyable
 			{
 			private:
 				std::vector<G3D::ReferenceCountedPointer<Chunk>> queue;
+
+				// Clusters the queue a pass at a time across frames, then hands the clusters out
+				// one at a time. Chunks joining or leaving the queue join or leave it too
+				std::auto_ptr<Clusterer> clusterer;
+				size_t nextCluster;
+				size_t queuedSinceClustering;
 			public:
+				Bucket();
+				~Bucket();
 				bool dequeueSleepingChunk(const G3D::ReferenceCountedPointer<Chunk>& chunk);
 				void addToQueue(const G3D::ReferenceCountedPointer<Chunk>&);
-				void clear()
-				{
-					queue.clear();
-				}
+				void clear();
+				// Works until G3D::System::getTick() reaches the deadline, carrying on next time
 				void optimize(AggregatingSceneManager&, double);
 			};
 
@@ -42,10 +52,30 @@ namespace RBX
 				bool operator<(const BucketKey&) const;
 			};
 
+			struct BucketKeyHasher
+			{
+				enum
+				{
+					bucket_size = 4,
+					min_buckets = 8
+				};
+
+				size_t operator()(const BucketKey& key) const;
+				bool operator()(const BucketKey& a, const BucketKey& b) const
+				{
+					return a < b;
+				}
+			};
+
 		private:
-			std::map<BucketKey, G3D::ReferenceCountedPointer<Bucket>> buckets;
-			std::set<G3D::WeakReferenceCountedPointer<Chunk>> invalidSleepingModels;
-			std::set<G3D::WeakReferenceCountedPointer<Chunk>> invalidMovingModels;
+			stdext::hash_map<BucketKey, G3D::ReferenceCountedPointer<Bucket>, BucketKeyHasher> buckets;
+			std::vector<G3D::ReferenceCountedPointer<Bucket>> bucketList;	// for taking turns in prerender
+			size_t nextBucket;
+
+			// Keyed by the chunk, and holding it until it's rebuilt or removed from the scene
+			typedef stdext::hash_map<Chunk*, G3D::ReferenceCountedPointer<Chunk>> InvalidModels;
+			InvalidModels invalidSleepingModels;
+			InvalidModels invalidMovingModels;
 		public:
 			static size_t aggregationSize;
 
@@ -58,10 +88,12 @@ namespace RBX
 			virtual void removeModel(const G3D::ReferenceCountedPointer<Chunk>& chunk);
 			virtual void clear();
 			virtual void setSleeping(const G3D::ReferenceCountedPointer<Chunk>& chunk, bool sleeping);
+			// Rebuilds out of date aggregates and builds new ones, for up to the given number of seconds
 			virtual void prerender(double);
 		private:
 			void dequeueSleepingChunk(const G3D::ReferenceCountedPointer<Chunk>& chunk);
 			void queueSleepingChunk(const G3D::ReferenceCountedPointer<Chunk>& chunk);
+			void constructAggregate(const std::vector<G3D::ReferenceCountedPointer<Chunk>>& components);
 			void deconstructAggregate(G3D::ReferenceCountedPointer<AggregateChunk>);
 		};
 	}
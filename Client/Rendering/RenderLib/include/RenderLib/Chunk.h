@@ -17,6 +17,11 @@ namespace RBX
 			const float polygonOffset;
 			float radius;
 			G3D::WeakReferenceCountedPointer<AggregateChunk> aggregate;
+
+			// Where an AggregatingSceneManager has this chunk queued, so it can leave the queue
+			// without a search. NULL while it isn't queued
+			void* sleepingBucket;
+			size_t sleepingIndex;
 		public:
 			static const float DECAL_OFFSET;
 			static const float TEXTURE_OFFSET;
@@ -38,7 +43,9 @@ namespace RBX
 
 			Chunk(float polygonOffset)
 				: polygonOffset(polygonOffset),
-				  radius(G3D::inf())
+				  radius(G3D::inf()),
+				  sleepingBucket(NULL),
+				  sleepingIndex(0)
 			{
 				RenderStats::chunkCount++;
 			}
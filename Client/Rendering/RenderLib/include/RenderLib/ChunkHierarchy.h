@@ -0,0 +1,90 @@
+#pragma once
+#include "RenderLib/Chunk.h"
+#include <G3D/Array.h>
+#include <G3D/Plane.h>
+#include <G3D/Vector3.h>
+#include <map>
+
+namespace RBX
+{
+	namespace Render
+	{
+		// Bounding volume hierarchy over the chunks in a scene, for culling against the camera.
+		// Leaves hold a box a little bigger than the chunk's sphere, so a moving chunk only goes
+		// back into the tree once it leaves that box. Only awake chunks are checked for movement;
+		// sleeping ones stay as they are until they wake up or are invalidated.
+		// Chunks that aren't cullable or have no finite radius sit outside the tree and are
+		// always visible.
+		class ChunkHierarchy
+		{
+		private:
+			struct Node
+			{
+				G3D::Vector3 low;
+				G3D::Vector3 high;
+				int parent;
+				int left;			// -1 for leaves
+				int right;
+
+				// leaves only
+				G3D::ReferenceCountedPointer<Chunk> chunk;
+				bool inTree;
+				bool sleeping;
+				int awakeIndex;		// in awakeLeaves, -1 while sleeping
+				int drawRank;		// position in the last draw order, -1 if it had none
+				int culledIndex;	// in culled, if it was part of the last cull
+			};
+
+			G3D::Array<Node> nodes;
+			G3D::Array<int> freeNodes;
+			int root;
+
+			std::map<const Chunk*, int> leaves;
+			G3D::Array<int> awakeLeaves;
+			G3D::Array<int> invalidLeaves;
+			G3D::Array<int> unboundedLeaves;
+
+			// the last ordered cull, for setDrawOrder
+			G3D::Array<int> culled;
+			int rankCount;
+			G3D::Array<int> rankSlots;
+
+			G3D::Array<int> result;
+			G3D::Array<int> stack;
+
+		public:
+			ChunkHierarchy();
+
+			void insert(const G3D::ReferenceCountedPointer<Chunk>& chunk);
+			void remove(const G3D::ReferenceCountedPointer<Chunk>& chunk);
+			void clear();
+
+			void setSleeping(const G3D::ReferenceCountedPointer<Chunk>& chunk, bool sleeping);
+			// The chunk's bounds changed; checked on the next update even if it sleeps
+			void invalidate(const G3D::ReferenceCountedPointer<Chunk>& chunk);
+
+			// Moves awake and invalidated chunks that have left their boxes
+			void update();
+
+			// Chunks that may be inside all the planes (which face inward), in the order last given
+			// to setDrawOrder. Chunks that weren't part of it come last
+			void cull(const G3D::Array<G3D::Plane>& planes, G3D::Array<Chunk*>& visible);
+			// Same test, in no particular order, leaving the draw order alone
+			void find(const G3D::Array<G3D::Plane>& planes, G3D::Array<Chunk*>& found);
+
+			// order[i] is an index into the chunks returned by the last cull
+			void setDrawOrder(const G3D::Array<int>& order);
+
+		private:
+			int allocateNode();
+			void freeNode(int node);
+			bool bounds(Chunk* chunk, G3D::Vector3& low, G3D::Vector3& high) const;
+			void place(int leaf);
+			void insertLeaf(int leaf);
+			void removeLeaf(int leaf);
+			void refit(int node);
+			void updateLeaf(int leaf);
+			void query(const G3D::Array<G3D::Plane>& planes, G3D::Array<int>& result);
+		};
+	}
+}
@@ -109,6 +109,11 @@ namespace RBX
 		public:
 			static void freeVertex(unsigned index);
 			static void setShadowVertex(const G3D::Vector3&);
+			// The shared vertex pool that Level index arrays point into, in object space
+			static const G3D::MeshAlg::Geometry& geometry()
+			{
+				return visibleGeometry;
+			}
 			static void beginRender(G3D::RenderDevice* rd, bool usetexCoords, bool useTangent);
 			static void sendGeometry(const Level* lvl, G3D::RenderDevice* rd);
 			static void endRender(G3D::RenderDevice* rd);
@@ -2,8 +2,12 @@
 #include "RenderLib/EffectSettings.h"
 #include "RenderLib/RenderSurface.h"
 #include "RenderLib/Chunk.h"
+#include "RenderLib/ChunkHierarchy.h"
+#include "RenderLib/SoftwareRasterizer.h"
 #include <GLG3D/Sky.h>
 #include <G3D/GCamera.h>
+#include <list>
+#include <map>
 
 namespace RBX
 {
@@ -14,6 +18,44 @@ namespace RBX
 			friend class SceneManager;
 
 		private:
+			// One proxy's shadow volume, in buffers of its own so proxies can be worked on in
+			// parallel. Index 0 is the shared vertex at infinity; vertexArray[0] only holds its place
+			struct ShadowSilhouette
+			{
+				G3D::ReferenceCountedPointer<Mesh> mesh;
+				G3D::Array<unsigned> indexArray;
+				G3D::Array<G3D::Vector3> vertexArray;
+				int lastUsed;
+				int proxy;	// in shadowProxyArray, during the pass that last used it
+			};
+
+			struct SilhouetteKey
+			{
+				const Mesh* mesh;
+				G3D::CoordinateFrame cframe;
+
+				bool operator<(const SilhouetteKey& other) const;
+			};
+
+			// Silhouettes for one light. Geometry that hasn't moved since the last pass keeps its own
+			struct SilhouetteCache
+			{
+				G3D::Vector3 lightDirection;
+				bool lightCap;
+				int lastUsed;
+				std::map<SilhouetteKey, ShadowSilhouette> silhouettes;
+			};
+
+			mutable std::list<SilhouetteCache> silhouetteCaches;
+			mutable G3D::Array<ShadowSilhouette*> passSilhouettes;	// one per shadowProxyArray entry
+			mutable G3D::Array<ShadowSilhouette*> staleSilhouettes;
+			mutable G3D::Array<int> passVertexOffsets;
+			mutable G3D::Array<int> passIndexOffsets;
+			mutable int shadowPass;
+
+			// per proxy, one vertex for every index of its mesh level, as triangles
+			std::vector<std::vector<SoftwareRasterizer::Vertex>> softwareVertices;
+
 			G3D::Array<RenderSurface> proxyArray;
 			G3D::Array<RenderSurface*> diffuseProxyArray;
 			G3D::Array<RenderSurface*> reflectProxyArray;
@@ -30,8 +72,14 @@ namespace RBX
 			float meshDetail;
 			bool shadows;
 			float cameraDistance;
-			G3D::Array<G3D::ReferenceCountedPointer<Chunk>> chunkArray;
 			G3D::Array<unsigned> shadowIndexArray;
+
+			ChunkHierarchy chunkHierarchy;	// holds every chunk in the scene
+			G3D::Array<G3D::Plane> cullPlanes;
+			G3D::Array<Chunk*> visibleChunks;	// in the order they were drawn last frame
+			G3D::Array<Chunk*> shadowChunks;
+			G3D::Array<int> proxyChunks;		// for each proxy, its chunk in visibleChunks
+			G3D::Array<int> drawOrder;
 		public:
 			RenderStats renderStats;
 			bool debugShadowVolumes;
@@ -43,8 +91,13 @@ namespace RBX
 		private:
 			void updateShadowVAR(const G3D::Array<G3D::Vector3>& shadowVertex);
 			void computeShadowVolumeGeometry(G3D::Array<unsigned>& indexArray, G3D::Array<G3D::Vector3>& shadowVertex, const G3D::GLight& light, bool generateLightCap, float shadowVertexDistance) const;
+			SilhouetteCache& silhouetteCache(const G3D::Vector3& lightDirection, bool lightCap) const;
+			void computeSilhouettes(size_t batch, const G3D::Vector3* lightDirection, bool lightCap) const;
+			void mergeSilhouettes(size_t batch, G3D::Array<unsigned>* indexArray, G3D::Array<G3D::Vector3>* shadowVertex) const;
 			void clearProxyArrays();
 			void allocateProxies(G3D::RenderDevice*, const G3D::GCamera&);
+			void allocateProxies(const G3D::GCamera& camera, const G3D::Rect2D& viewport, bool cacheShadows);
+			bool allocateProxy(Chunk* chunk, const G3D::CoordinateFrame& cameraFrame, RenderSurface& proxy) const;
 			void classifyProxies();
 			void sortProxies();
 			void computeProxyArrays(G3D::RenderDevice* rd, const G3D::GCamera& camera);
@@ -57,6 +110,8 @@ namespace RBX
 			void transparentPass(G3D::RenderDevice* rd);
 			void debugShowTextures(G3D::RenderDevice*, const G3D::GCamera&);
 			void renderShadowVolumeGeometry(G3D::RenderDevice* rd, const G3D::GLight& light, bool caps, float shadowVertexDistance);
+			void lightSoftwareProxy(size_t proxy, const G3D::Vector3* eye);
+			void sendSoftwareProxies(SoftwareRasterizer& target, const G3D::Array<RenderSurface*>& proxies, SoftwareRasterizer::PassMode mode) const;
 		public:
 			//RenderScene(const RenderScene&);
 			RenderScene();
@@ -68,6 +123,9 @@ namespace RBX
 			float getShadingQuality() const;
 			float getMeshDetail() const;
 			void render(G3D::RenderDevice* rd, const G3D::GCamera& camera);
+			// Draws the scene on the CPU, with the same passes as render. Textures are left out and
+			// reflections show the sky's ambient color rather than the environment map
+			void renderSoftware(SoftwareRasterizer& target, const G3D::GCamera& camera);
 			//RenderScene& operator=(const RenderScene&);
 		};
 
@@ -91,15 +149,23 @@ namespace RBX
 			}
 			void clearScene()
 			{
-				renderScene->chunkArray.clear();
+				renderScene->chunkHierarchy.clear();
 			}
 			void addToScene(const G3D::ReferenceCountedPointer<Chunk>& chunk)
 			{
-				renderScene->chunkArray.push_back(chunk);
+				renderScene->chunkHierarchy.insert(chunk);
 			}
 			void removeFromScene(const G3D::ReferenceCountedPointer<Chunk>& chunk)
 			{
-				renderScene->chunkArray.fastRemove(renderScene->chunkArray.findIndex(chunk));
+				renderScene->chunkHierarchy.remove(chunk);
+			}
+			void setSleepingInScene(const G3D::ReferenceCountedPointer<Chunk>& chunk, bool sleeping)
+			{
+				renderScene->chunkHierarchy.setSleeping(chunk, sleeping);
+			}
+			void invalidateInScene(const G3D::ReferenceCountedPointer<Chunk>& chunk)
+			{
+				renderScene->chunkHierarchy.invalidate(chunk);
 			}
 		};
 	}
@@ -20,6 +20,8 @@ public:
 	int markShadowsTriangles;
 	int shadowedLightTriangles;
 	int unshadowedTriangles;
+	mutable int shadowSilhouettesComputed;
+	mutable int shadowSilhouettesReused;
 
 public:
 	static int chunkCount;
@@ -0,0 +1,119 @@
+#pragma once
+#include <G3D/Array.h>
+#include <G3D/Color3.h>
+#include <G3D/CoordinateFrame.h>
+#include <G3D/GCamera.h>
+#include <G3D/GImage.h>
+#include <G3D/Vector3.h>
+#include <vector>
+
+namespace RBX
+{
+	namespace Render
+	{
+		// Draws triangles into an image in memory, for rendering on machines without a graphics card.
+		// A pass collects triangles, which are clipped, projected and sorted into screen tiles in the
+		// order they arrive; endPass then draws the tiles in parallel. Every pixel keeps two colors,
+		// with and without the shadowed lights. The shadow volume pass counts into a stencil the way
+		// the GL path does (z-fail), and resolveShadows picks the color for each pixel.
+		class SoftwareRasterizer
+		{
+		public:
+			enum PassMode
+			{
+				OpaquePass,			// depth tested and written, back faces culled
+				ShadowVolumePass,	// both faces, only the stencil changes
+				AdditivePass,		// added onto the resolved color, no depth write
+				BlendPass			// blended by alpha onto the resolved color, no depth write
+			};
+
+			struct Vertex
+			{
+				G3D::Vector3 position;	// world space
+				G3D::Color3 lit;		// lit by every light
+				G3D::Color3 unlit;		// without the shadowed lights
+				float alpha;
+			};
+
+		private:
+			// screen space; colors are divided by w so they interpolate in perspective
+			struct ScreenVertex
+			{
+				float x;
+				float y;
+				float invW;
+				G3D::Color3 lit;
+				G3D::Color3 unlit;
+				float alpha;
+			};
+
+			struct Triangle
+			{
+				ScreenVertex v[3];
+				float depthScale;	// polygon offset
+				bool frontFacing;
+				int minX;
+				int minY;
+				int maxX;
+				int maxY;
+			};
+
+			static const int tileSize = 64;
+
+			int width;
+			int height;
+			int tilesX;
+			int tilesY;
+
+			G3D::CoordinateFrame cameraFrame;
+			float nearZ;
+			float focalLength;	// in pixels
+
+			PassMode mode;
+			G3D::Array<Triangle> triangles;
+			std::vector<G3D::Array<int>> tileTriangles;
+
+			// 1/w of the nearest surface; 0 is infinitely far
+			G3D::Array<float> depth;
+			G3D::Array<G3D::Color3> litColor;	// the final color once shadows are resolved
+			G3D::Array<G3D::Color3> unlitColor;
+			G3D::Array<int> stencil;
+
+		public:
+			SoftwareRasterizer(int width, int height);
+
+			int getWidth() const
+			{
+				return width;
+			}
+			int getHeight() const
+			{
+				return height;
+			}
+			const G3D::Vector3& cameraPosition() const
+			{
+				return cameraFrame.translation;
+			}
+
+			void setCamera(const G3D::GCamera& camera);
+			void clear(const G3D::Color3& color);
+
+			void beginPass(PassMode mode);
+			// depthOffset works like RenderDevice::setPolygonOffset: negative pulls the surface forward
+			void addTriangle(const Vertex& a, const Vertex& b, const Vertex& c, float depthOffset);
+			void endPass();
+
+			// Pixels inside a shadow volume take their unlit color
+			void resolveShadows();
+
+			void getImage(G3D::GImage& image) const;
+
+		private:
+			ScreenVertex project(const G3D::Vector3& cameraSpace, const Vertex& vertex) const;
+			void addClipped(const ScreenVertex& a, const ScreenVertex& b, const ScreenVertex& c, float depthScale);
+			void rasterizeTile(size_t tile);
+			void rasterizeTriangle(const Triangle& triangle, int minX, int minY, int maxX, int maxY);
+			void resolveTile(size_t tile);
+		};
+	}
+}